@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "image.h"
+#include "test.h"
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// Runs EX N times and prints the mean wall time per run
+#define BENCH(NAME, N, EX) do { double t0_ = now(); int i_; \
+    for(i_ = 0; i_ < (N); ++i_) { EX; } \
+    printf("%-36s %10.3f ms\n", NAME, (now() - t0_)*1000/(N)); } while (0)
+
+// Same in microseconds, for calls too quick to show in ms
+#define BENCH_US(NAME, N, EX) do { double t0_ = now(); int i_; \
+    for(i_ = 0; i_ < (N); ++i_) { EX; } \
+    printf("%-36s %10.3f us\n", NAME, (now() - t0_)*1e6/(N)); } while (0)
+
+void bench_remap()
+{
+    image im = load_image("data/dog.jpg");
+    image out = make_image(im.w, im.h, im.c);
+    remap_map map;
+
+    BENCH("remap build float", 20, map = make_undistort_remap(im.w, im.h, -.2, .05, REMAP_FLOAT); free_remap(map));
+    BENCH("remap build fixed", 20, map = make_undistort_remap(im.w, im.h, -.2, .05, REMAP_FIXED); free_remap(map));
+
+    map = make_undistort_remap(im.w, im.h, -.2, .05, REMAP_FLOAT);
+    BENCH("remap apply float", 20, remap_image(im, out, map));
+    free_remap(map);
+    map = make_undistort_remap(im.w, im.h, -.2, .05, REMAP_FIXED);
+    BENCH("remap apply fixed", 20, remap_image(im, out, map));
+    free_remap(map);
+
+    free_image(out);
+    free_image(im);
+}
+
+void bench_color()
+{
+    image im = load_image("data/dog.jpg");
+    image g;
+    BENCH("rgb_to_grayscale", 200, g = rgb_to_grayscale(im); free_image(g));
+    BENCH("rgb_to_hsv", 200, rgb_to_hsv(im));
+    BENCH("hsv_to_rgb", 200, hsv_to_rgb(im));
+    BENCH("rgb_to_ycbcr", 200, rgb_to_ycbcr(im));
+    BENCH("ycbcr_to_rgb", 200, ycbcr_to_rgb(im));
+    clamp_image(im);
+    BENCH("rgb_to_lab + lab_to_rgb", 100, rgb_to_lab(im); lab_to_rgb(im));
+    free_image(im);
+
+    image hwc;
+    BENCH("load_image chw", 20, im = load_image("data/dog.jpg"); free_image(im));
+    BENCH("load_image hwc", 20, hwc = load_image_layout("data/dog.jpg", LAYOUT_HWC); free_image(hwc));
+    hwc = load_image_layout("data/dog.jpg", LAYOUT_HWC);
+    BENCH("rgb_to_grayscale hwc", 200, g = rgb_to_grayscale(hwc); free_image(g));
+    BENCH("rgb_to_hsv hwc", 200, rgb_to_hsv(hwc));
+    free_image(hwc);
+}
+
+void saturate(image im, void *ctx)
+{
+    rgb_to_hsv(im);
+    shift_image(im, 1, .2);
+    clamp_image(im);
+    hsv_to_rgb(im);
+}
+
+void bench_histogram()
+{
+    image im = load_image("data/dog.jpg");
+    histogram h;
+    BENCH("histogram 256 bins", 200, h = make_histogram(im, 256, 0, 1); free_histogram(h));
+    BENCH("equalize_histogram", 100, equalize_histogram(im, 256));
+    BENCH("clahe 8x8", 100, clahe_image(im, 8, 8, 2));
+    free_image(im);
+}
+
+void bench_point_ops()
+{
+    image im = load_image("data/dog.jpg");
+    point_ops p = make_point_ops();
+    add_point_affine(&p, -1, 1, .01);
+    add_point_affine(&p, -1, .99, 0);
+    add_point_clamp(&p, -1, 0, 1);
+    BENCH("shift, scale, clamp passes", 200, shift_image(im, 0, .01); shift_image(im, 1, .01); shift_image(im, 2, .01);
+          scale_image(im, 0, .99); scale_image(im, 1, .99); scale_image(im, 2, .99); clamp_image(im));
+    BENCH("fused point ops", 200, apply_point_ops(im, p));
+    free_point_ops(p);
+    free_image(im);
+}
+
+void bench_lut()
+{
+    image im = load_image("data/dog.jpg");
+    color_lut lut;
+    BENCH("hsv saturate chain", 50, saturate(im, 0));
+    BENCH("lut bake 33", 20, lut = bake_color_lut(33, saturate, 0); free_color_lut(lut));
+    BENCH("lut bake 65", 5, lut = bake_color_lut(65, saturate, 0); free_color_lut(lut));
+    lut = bake_color_lut(33, saturate, 0);
+    BENCH("lut apply 33", 50, apply_color_lut(im, lut));
+    free_color_lut(lut);
+    free_image(im);
+}
+
+void free_sobel(image *res)
+{
+    free_image(res[0]);
+    free_image(res[1]);
+    free(res);
+}
+
+void bench_pool()
+{
+    image im = load_image("data/dog.jpg");
+    BENCH("make + free 1080p, pooled", 100, free_image(make_image(1920, 1080, 3)));
+    BENCH("sobel_image, pooled", 20, free_sobel(sobel_image(im)));
+    set_image_pool_limit(0);
+    BENCH("make + free 1080p, no pool", 100, free_image(make_image(1920, 1080, 3)));
+    BENCH("sobel_image, no pool", 20, free_sobel(sobel_image(im)));
+    set_image_pool_limit((size_t)256 << 20);
+    free_image(im);
+}
+
+void bench_storage_types()
+{
+    image im = load_image("data/dog.jpg");
+    image u8 = convert_image(im, IMAGE_U8);
+    image f16 = convert_image(im, IMAGE_F16);
+    image r;
+    BENCH("bilinear_resize f32", 50, r = bilinear_resize(im, 1024, 768); free_image(r));
+    BENCH("bilinear_resize u8", 50, r = bilinear_resize(u8, 1024, 768); free_image(r));
+    BENCH("bilinear_resize f16", 50, r = bilinear_resize(f16, 1024, 768); free_image(r));
+    BENCH("rgb_to_hsv f32", 200, rgb_to_hsv(im));
+    BENCH("rgb_to_hsv u8", 200, rgb_to_hsv(u8));
+    BENCH("rgb_to_hsv f16", 200, rgb_to_hsv(f16));
+    free_image(im);
+    free_image(u8);
+    free_image(f16);
+}
+
+// A per frame pipeline: downscale, grayscale, blur, difference
+void bench_into()
+{
+    image im = load_image("data/dog.jpg");
+    image f = make_gaussian_filter(1);
+    BENCH("frame pipeline, allocating", 50, {
+        image s = bilinear_resize(im, 384, 288);
+        image g = rgb_to_grayscale(s);
+        image b = convolve_image(g, f, 1);
+        image d = sub_image(g, b);
+        free_image(s); free_image(g); free_image(b); free_image(d);
+    });
+    image s = make_image(384, 288, 3), g = make_image(384, 288, 1), b = make_image(384, 288, 1);
+    BENCH("frame pipeline, into", 50, {
+        bilinear_resize_into(im, s);
+        rgb_to_grayscale_into(s, g);
+        convolve_image_into(g, f, 1, b);
+        sub_image_into(g, b, b);
+    });
+    free_image(s); free_image(g); free_image(b);
+    free_image(f);
+    free_image(im);
+}
+
+void bench_share()
+{
+    image im = load_image("data/dog.jpg");
+    image c;
+    BENCH("copy_image", 200, c = copy_image(im); free_image(c));
+    BENCH("share_image", 200, c = share_image(im); free_image(c));
+    BENCH("share_image + make_writable", 200, c = share_image(im); make_writable(&c); free_image(c));
+    free_image(im);
+}
+
+// Thumbnail sized work, where per call and per row overhead matters most
+void bench_small()
+{
+    image im = load_image("data/dog.jpg");
+    image s = bilinear_resize(im, 64, 48);
+    image r = make_image(32, 24, 3), g = make_image(64, 48, 1), a = make_image(64, 48, 3);
+    BENCH_US("small bilinear_resize_into", 20000, bilinear_resize_into(s, r));
+    BENCH_US("small rgb_to_grayscale_into", 20000, rgb_to_grayscale_into(s, g));
+    BENCH_US("small add_image_into", 20000, add_image_into(s, s, a));
+    BENCH_US("small copy_image", 20000, free_image(copy_image(s)));
+    BENCH_US("small get_pixel sweep", 2000, {
+        float sum = 0;
+        for (int c = 0; c < s.c; c++) for (int y = 0; y < s.h; y++) for (int x = 0; x < s.w; x++) sum += get_pixel(s, x, y, c);
+        set_pixel(a, 0, 0, 0, sum);
+    });
+    free_image(im); free_image(s); free_image(r); free_image(g); free_image(a);
+}
+
+void bench_tiled()
+{
+    image im = load_image("data/dog.jpg");
+    image big = bilinear_resize(im, 2048, 1536);
+    image f = make_gaussian_filter(1);
+    image r;
+    BENCH("convolve 2048x1536 in memory", 1, r = convolve_image(big, f, 1); free_image(r));
+    BENCH("bilinear_resize /4 in memory", 5, r = bilinear_resize(big, 512, 384); free_image(r));
+    tiled_image t, out;
+    BENCH("tile_image 2048x1536", 5, t = tile_image(big, 256, 16); free_tiled_image(t));
+    t = tile_image(big, 256, 16);
+    out = make_tiled_image(big.w, big.h, big.c, 256, 16);
+    BENCH("convolve_tiled 2048x1536", 1, convolve_tiled(t, f, 1, out));
+    free_tiled_image(out);
+    out = make_tiled_image(512, 384, big.c, 256, 16);
+    BENCH("resize_tiled /4", 5, resize_tiled(t, out, RESIZE_BILINEAR));
+    free_tiled_image(out);
+    free_tiled_image(t);
+    free_image(f);
+    free_image(big);
+    free_image(im);
+}
+
+void run_benchmarks()
+{
+    bench_color();
+    bench_remap();
+    bench_point_ops();
+    bench_histogram();
+    bench_lut();
+    bench_pool();
+    bench_storage_types();
+    bench_into();
+    bench_share();
+    bench_small();
+    bench_tiled();
+}
@@ -0,0 +1,305 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "image.h"
+
+// Pixels of an interleaved row gathered into planar scratch at a time
+#define RGB_BLOCK 256
+
+static inline void split_rgb(const float *restrict p, int step, size_t plane, int n,
+                             float *restrict r, float *restrict g, float *restrict b)
+{
+    for (int i = 0; i < n; i++)
+    {
+        r[i] = p[i*step];
+        g[i] = p[i*step + plane];
+        b[i] = p[i*step + 2*plane];
+    }
+}
+
+static inline void merge_rgb(float *restrict p, int step, size_t plane, int n,
+                             const float *restrict r, const float *restrict g, const float *restrict b)
+{
+    for (int i = 0; i < n; i++)
+    {
+        p[i*step] = r[i];
+        p[i*step + plane] = g[i];
+        p[i*step + 2*plane] = b[i];
+    }
+}
+
+// Runs fn over the first three channels of im a row at a time across
+// threads. Planar float rows are handed over in place; interleaved rows
+// are split into r, g, b blocks on the stack and merged back afterwards,
+// and compact types are widened into such blocks and narrowed back.
+void for_each_rgb_block(image im, rgb_block_fn fn, void *ctx)
+{
+    assert(im.c >= 3);
+    if (im.type != IMAGE_F32)
+    {
+        #pragma omp parallel for
+        for (int y = 0; y < im.h; y++)
+        {
+            float rgb[3][RGB_BLOCK];
+            for (int start = 0; start < im.w; start += RGB_BLOCK)
+            {
+                int n = (start + RGB_BLOCK < im.w) ? RGB_BLOCK : im.w - start;
+                for (int k = 0; k < 3; k++) widen_pixels(im.type, image_ptr(im, start, y, k), im.step, rgb[k], n);
+                fn(rgb[0], rgb[1], rgb[2], n, ctx);
+                for (int k = 0; k < 3; k++) narrow_pixels(im.type, image_ptr(im, start, y, k), im.step, rgb[k], n);
+            }
+        }
+        return;
+    }
+    // Packed RGB gets the constant strides inlined
+    int packed = im.step == 3 && im.plane == 1;
+    #pragma omp parallel for
+    for (int y = 0; y < im.h; y++)
+    {
+        float *row = image_row(im, y, 0);
+        if (im.step == 1)
+        {
+            fn(row, image_row(im, y, 1), image_row(im, y, 2), im.w, ctx);
+            continue;
+        }
+        float r[RGB_BLOCK], g[RGB_BLOCK], b[RGB_BLOCK];
+        for (int start = 0; start < im.w; start += RGB_BLOCK)
+        {
+            int n = (start + RGB_BLOCK < im.w) ? RGB_BLOCK : im.w - start;
+            float *p = row + start*im.step;
+            if (packed) split_rgb(p, 3, 1, n, r, g, b);
+            else split_rgb(p, im.step, im.plane, n, r, g, b);
+            fn(r, g, b, n, ctx);
+            if (packed) merge_rgb(p, 3, 1, n, r, g, b);
+            else merge_rgb(p, im.step, im.plane, n, r, g, b);
+        }
+    }
+}
+
+// Scales r, g, b by the alpha in channel 3
+void premultiply_alpha(image im)
+{
+    assert(im.c == 4 && im.type == IMAGE_F32);
+    assert(image_exclusive(im));
+    #pragma omp parallel for
+    for (int y = 0; y < im.h; y++)
+    {
+        const float *a = image_row(im, y, 3);
+        for (int k = 0; k < 3; k++)
+        {
+            float *v = image_row(im, y, k);
+            for (int x = 0; x < im.w; x++) v[x*im.step] *= a[x*im.step];
+        }
+    }
+}
+
+// Back to straight alpha. Fully transparent pixels have no colour left
+// to recover and become 0.
+void unpremultiply_alpha(image im)
+{
+    assert(im.c == 4 && im.type == IMAGE_F32);
+    assert(image_exclusive(im));
+    #pragma omp parallel for
+    for (int y = 0; y < im.h; y++)
+    {
+        const float *a = image_row(im, y, 3);
+        for (int k = 0; k < 3; k++)
+        {
+            float *v = image_row(im, y, k);
+            for (int x = 0; x < im.w; x++)
+            {
+                float s = a[x*im.step] > 0 ? 1 / a[x*im.step] : 0;
+                v[x*im.step] *= s;
+            }
+        }
+    }
+}
+
+static inline float bits_to_float(uint32_t i)
+{
+    float f;
+    memcpy(&f, &i, sizeof(f));
+    return f;
+}
+
+static inline uint32_t float_to_bits(float f)
+{
+    uint32_t i;
+    memcpy(&i, &f, sizeof(i));
+    return i;
+}
+
+// log2 for x > 0: exponent from the bits, mantissa folded into
+// [sqrt(1/2), sqrt(2)) and ln(m) = 2 atanh((m-1)/(m+1)) to the t^7 term.
+// Relative error is below 1e-7.
+static inline float fast_log2f(float x)
+{
+    uint32_t i = float_to_bits(x);
+    int e = (int)((i >> 23) & 0xff) - 127;
+    float m = bits_to_float((i & 0x7fffff) | 0x3f800000);
+    int big = m > 1.41421356f;
+    m = big ? m * .5f : m;
+    e += big;
+    float t = (m - 1) / (m + 1);
+    float t2 = t*t;
+    float ln = 2*t*(1 + t2*(1.f/3 + t2*(1.f/5 + t2*(1.f/7))));
+    return e + ln * 1.44269504f;
+}
+
+// 2^x for x in the float range: 2^round(x) from the bits times a degree
+// 6 Taylor series of e^(f ln 2) for |f| <= 1/2. Relative error < 2e-7.
+static inline float fast_exp2f(float x)
+{
+    x = fminf(fmaxf(x, -126.f), 127.f);
+    float r = (float)(int)(x + (x < 0 ? -.5f : .5f));
+    float f = (x - r) * .693147181f;
+    float p = 1 + f*(1 + f*(1.f/2 + f*(1.f/6 + f*(1.f/24 + f*(1.f/120 + f*(1.f/720))))));
+    return p * bits_to_float((uint32_t)((int)r + 127) << 23);
+}
+
+static inline float fast_powf(float x, float y)
+{
+    return fast_exp2f(y * fast_log2f(x));
+}
+
+// Cube root for x >= 0: bit trick first guess, then two Newton steps
+static inline float fast_cbrtf(float x)
+{
+    x = fmaxf(x, 1e-30f);
+    float y = bits_to_float(float_to_bits(x)/3 + 709921077);
+    y = (2*y + x/(y*y)) * (1.f/3);
+    y = (2*y + x/(y*y)) * (1.f/3);
+    return y;
+}
+
+static inline float srgb_decode(float v)
+{
+    float p = fast_powf(fmaxf((v + .055f) * (1/1.055f), 1e-30f), 2.4f);
+    return (v <= .04045f) ? v * (1/12.92f) : p;
+}
+
+static inline float srgb_encode(float v)
+{
+    float p = 1.055f*fast_powf(fmaxf(v, 1e-30f), 1/2.4f) - .055f;
+    return (v <= .0031308f) ? v * 12.92f : p;
+}
+
+// YCbCr is full range BT.601 (JPEG) with chroma centred on .5
+
+static void rgb_to_ycbcr_block(float *restrict r, float *restrict g, float *restrict b, int n, void *ctx)
+{
+    for (int i = 0; i < n; i++)
+    {
+        float R = r[i], G = g[i], B = b[i];
+        r[i] = .299f*R + .587f*G + .114f*B;
+        g[i] = -.168735892f*R - .331264108f*G + .5f*B + .5f;
+        b[i] = .5f*R - .418687589f*G - .081312411f*B + .5f;
+    }
+}
+
+static void ycbcr_to_rgb_block(float *restrict r, float *restrict g, float *restrict b, int n, void *ctx)
+{
+    for (int i = 0; i < n; i++)
+    {
+        float Y = r[i], Cb = g[i] - .5f, Cr = b[i] - .5f;
+        r[i] = Y + 1.402f*Cr;
+        g[i] = Y - .344136286f*Cb - .714136286f*Cr;
+        b[i] = Y + 1.772f*Cb;
+    }
+}
+
+// CIELAB relative to D65 white, L in [0,100]
+#define LAB_EPS (216.f/24389)
+#define LAB_KAPPA (24389.f/27)
+
+static inline float lab_f(float t)
+{
+    return (t > LAB_EPS) ? fast_cbrtf(t) : (LAB_KAPPA*t + 16) * (1.f/116);
+}
+
+static inline float lab_finv(float f)
+{
+    return (f > 6.f/29) ? f*f*f : (116*f - 16) * (1/LAB_KAPPA);
+}
+
+// RGB is sRGB encoded unless linear light is on, then it is used as is.
+// srgb is a constant at each call so each case gets its own loop.
+static inline void rgb_to_lab_run(float *restrict r, float *restrict g, float *restrict b, int n, int srgb)
+{
+    for (int i = 0; i < n; i++)
+    {
+        float R = srgb ? srgb_decode(r[i]) : r[i];
+        float G = srgb ? srgb_decode(g[i]) : g[i];
+        float B = srgb ? srgb_decode(b[i]) : b[i];
+        float X = (.4124564f*R + .3575761f*G + .1804375f*B) * (1/.95047f);
+        float Y =  .2126729f*R + .7151522f*G + .0721750f*B;
+        float Z = (.0193339f*R + .1191920f*G + .9503041f*B) * (1/1.08883f);
+        float fx = lab_f(X), fy = lab_f(Y), fz = lab_f(Z);
+        r[i] = 116*fy - 16;
+        g[i] = 500*(fx - fy);
+        b[i] = 200*(fy - fz);
+    }
+}
+
+static void rgb_to_lab_block(float *restrict r, float *restrict g, float *restrict b, int n, void *ctx)
+{
+    if (*(const int *)ctx) rgb_to_lab_run(r, g, b, n, 1);
+    else rgb_to_lab_run(r, g, b, n, 0);
+}
+
+static inline void lab_to_rgb_run(float *restrict r, float *restrict g, float *restrict b, int n, int srgb)
+{
+    for (int i = 0; i < n; i++)
+    {
+        float fy = (r[i] + 16) * (1.f/116);
+        float fx = fy + g[i] * (1.f/500);
+        float fz = fy - b[i] * (1.f/200);
+        float X = lab_finv(fx) * .95047f;
+        float Y = lab_finv(fy);
+        float Z = lab_finv(fz) * 1.08883f;
+        float R =  3.2404542f*X - 1.5371385f*Y - .4985314f*Z;
+        float G = -.9692660f*X + 1.8760108f*Y + .0415560f*Z;
+        float B =  .0556434f*X - .2040259f*Y + 1.0572252f*Z;
+        r[i] = srgb ? srgb_encode(R) : R;
+        g[i] = srgb ? srgb_encode(G) : G;
+        b[i] = srgb ? srgb_encode(B) : B;
+    }
+}
+
+static void lab_to_rgb_block(float *restrict r, float *restrict g, float *restrict b, int n, void *ctx)
+{
+    if (*(const int *)ctx) lab_to_rgb_run(r, g, b, n, 1);
+    else lab_to_rgb_run(r, g, b, n, 0);
+}
+
+void rgb_to_ycbcr(image im)
+{
+    assert(im.c == 3);
+    assert(image_exclusive(im));
+    for_each_rgb_block(im, rgb_to_ycbcr_block, 0);
+}
+
+void ycbcr_to_rgb(image im)
+{
+    assert(im.c == 3);
+    assert(image_exclusive(im));
+    for_each_rgb_block(im, ycbcr_to_rgb_block, 0);
+}
+
+// L runs to 100 and a, b go negative, which 8-bit storage can't hold
+void rgb_to_lab(image im)
+{
+    assert(im.c == 3 && im.type != IMAGE_U8);
+    assert(image_exclusive(im));
+    int srgb = !get_linear_light();
+    for_each_rgb_block(im, rgb_to_lab_block, &srgb);
+}
+
+void lab_to_rgb(image im)
+{
+    assert(im.c == 3 && im.type != IMAGE_U8);
+    assert(image_exclusive(im));
+    int srgb = !get_linear_light();
+    for_each_rgb_block(im, lab_to_rgb_block, &srgb);
+}
@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <string.h>
+#include "image.h"
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+// Compact storage: kernels widen a run of pixels to float, work in float
+// and narrow the results back, so u8 and f16 images never exist as a full
+// float copy.
+
+static inline uint32_t f32_bits(float f)
+{
+    uint32_t i;
+    memcpy(&i, &f, sizeof(i));
+    return i;
+}
+
+static inline float bits_f32(uint32_t i)
+{
+    float f;
+    memcpy(&f, &i, sizeof(f));
+    return f;
+}
+
+float half_to_float(uint16_t h)
+{
+#ifdef __F16C__
+    return _cvtsh_ss(h);
+#else
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t man = h & 0x3ff;
+    if (exp == 0x1f) return bits_f32(sign | 0x7f800000 | (man << 13));
+    if (exp == 0)
+    {
+        // Subnormal halves are man * 2^-24, exact in float
+        float f = man * (1.f / (1 << 24));
+        return sign ? -f : f;
+    }
+    return bits_f32(sign | ((exp + 112) << 23) | (man << 13));
+#endif
+}
+
+uint16_t float_to_half(float f)
+{
+#ifdef __F16C__
+    return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+    uint32_t x = f32_bits(f);
+    uint16_t sign = (x >> 16) & 0x8000;
+    uint32_t a = x & 0x7fffffff;
+    // 2^16 and up is out of range: infinity, NaN stays a (quiet) NaN
+    if (a >= 0x47800000) return sign | (a > 0x7f800000 ? 0x7e00 : 0x7c00);
+    if (a < 0x38800000)
+    {
+        // Below the smallest normal half: scale so the result lands in the
+        // low mantissa bits and let the float add round to nearest even
+        float r = bits_f32(a) + .5f;
+        return sign | (uint16_t)(f32_bits(r) - f32_bits(.5f));
+    }
+    // Rebias the exponent and round the 13 dropped bits to nearest even
+    uint32_t odd = (a >> 13) & 1;
+    a += 0xc8000fff + odd;
+    return sign | (uint16_t)(a >> 13);
+#endif
+}
+
+static inline float u8_to_float(unsigned char v)
+{
+    return v * (1.f/255);
+}
+
+static inline unsigned char float_to_u8(float v)
+{
+    v = v < 0 ? 0 : (v > 1 ? 1 : v);
+    return (unsigned char)(v*255 + .5f);
+}
+
+// Reads n pixels step elements apart starting at src into out
+void widen_pixels(int type, const void *src, int step, float *out, int n)
+{
+    int i = 0;
+    if (type == IMAGE_F32)
+    {
+        const float *p = src;
+        for (; i < n; i++) out[i] = p[i*step];
+    }
+    else if (type == IMAGE_U8)
+    {
+        const unsigned char *p = src;
+        for (; i < n; i++) out[i] = u8_to_float(p[i*step]);
+    }
+    else
+    {
+        const uint16_t *p = src;
+#ifdef __F16C__
+        if (step == 1)
+        {
+            for (; i + 8 <= n; i += 8)
+            {
+                _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(p + i))));
+            }
+        }
+#endif
+        for (; i < n; i++) out[i] = half_to_float(p[i*step]);
+    }
+}
+
+// Writes n floats from in to pixels step elements apart starting at dst
+void narrow_pixels(int type, void *dst, int step, const float *in, int n)
+{
+    int i = 0;
+    if (type == IMAGE_F32)
+    {
+        float *p = dst;
+        for (; i < n; i++) p[i*step] = in[i];
+    }
+    else if (type == IMAGE_U8)
+    {
+        unsigned char *p = dst;
+        for (; i < n; i++) p[i*step] = float_to_u8(in[i]);
+    }
+    else
+    {
+        uint16_t *p = dst;
+#ifdef __F16C__
+        if (step == 1)
+        {
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+                _mm_storeu_si128((__m128i *)(p + i), h);
+            }
+        }
+#endif
+        for (; i < n; i++) p[i*step] = float_to_half(in[i]);
+    }
+}
+
+void widen_row(image im, int y, int c, float *out)
+{
+    widen_pixels(im.type, image_ptr(im, 0, y, c), im.step, out, im.w);
+}
+
+void narrow_row(image im, int y, int c, const float *in)
+{
+    narrow_pixels(im.type, image_ptr(im, 0, y, c), im.step, in, im.w);
+}
+
+// Planar copy of im stored as type
+image convert_image(image im, int type)
+{
+    image out = make_image_typed(im.w, im.h, im.c, type);
+    float *row = malloc(im.w*sizeof(float));
+    for (int c = 0; c < im.c; c++)
+    {
+        for (int y = 0; y < im.h; y++)
+        {
+            widen_row(im, y, c, row);
+            narrow_row(out, y, c, row);
+        }
+    }
+    free(row);
+    return out;
+}
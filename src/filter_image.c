@@ -3,6 +3,7 @@
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <limits.h>
 #include "image.h"
 #define TWOPI 6.2831853
 
@@ -51,48 +52,92 @@ image make_box_filter(int w)
     return new_image;
 }
 
+// Filter responses leave [0, 1] (highpass, emboss, sobel go negative), so
+// 8-bit inputs come back as F32 rather than clamped. F16 holds them fine
+// and keeps its type, like the resizes do.
 image convolve_image(image im, image filter, int preserve)
+{
+    // Every output pixel is written by convolve_image_into
+    int type = (im.type == IMAGE_F16) ? IMAGE_F16 : IMAGE_F32;
+    image new_image = make_image_uninit_typed(im.w, im.h, preserve ? im.c : 1, LAYOUT_CHW, type);
+    convolve_image_into(im, filter, preserve, new_image);
+    return new_image;
+}
+
+// Whether the pixels of a and b can share memory. Views of one buffer have
+// different data pointers, so whole address ranges are compared.
+static int images_overlap(image a, image b)
+{
+    if (!a.w || !a.h || !a.c || !b.w || !b.h || !b.c) return 0;
+    const unsigned char *a1 = (const unsigned char *)image_ptr(a, a.w-1, a.h-1, a.c-1) + image_elem_size(a.type);
+    const unsigned char *b1 = (const unsigned char *)image_ptr(b, b.w-1, b.h-1, b.c-1) + image_elem_size(b.type);
+    return a.u8 < b1 && b.u8 < a1;
+}
+
+// Every output reads a window of neighbours, so out must not share im's pixels.
+// Source rows are widened to float once each into a ring of filter.h rows,
+// padded with the zeros get_pixel returns outside the image.
+void convolve_image_into(image im, image filter, int preserve, image new_image)
 {
     assert(filter.c == im.c || filter.c == 1);
 
     int channels = preserve ? im.c : 1;
-    image new_image = make_image(im.w, im.h, channels);
+    assert(new_image.w == im.w && new_image.h == im.h && new_image.c == channels);
+    assert(!images_overlap(new_image, im));
+
+    int pad = filter.w / 2;
+    int span = im.w + filter.w - 1;
+    float *ring = calloc((size_t)filter.h*span + im.w, sizeof(float));
+    float *out = ring + (size_t)filter.h*span;
+    int *cached = malloc(filter.h*sizeof(int));
+    float *taps = malloc(filter.c*filter.h*filter.w*sizeof(float));
+    for (int fc = 0; fc < filter.c; fc++)
+        for (int fh = 0; fh < filter.h; fh++)
+            for (int fw = 0; fw < filter.w; fw++)
+                taps[(fc*filter.h + fh)*filter.w + fw] = get_pixel(filter, fw, fh, fc);
 
     for (int c = 0; c < channels; c++) 
     {
+        int im_c = preserve ? c : 0;
+        for (int i = 0; i < filter.h; i++) cached[i] = INT_MIN;
         for (int h = 0; h < im.h; h++) 
         {
-            for (int w = 0; w < im.w; w++) 
+            // Only the row entering the window is new
+            for (int fh = 0; fh < filter.h; fh++)
             {
+                int y = h + fh - filter.h / 2;
+                int slot = ((y % filter.h) + filter.h) % filter.h;
+                if (cached[slot] == y) continue;
+                float *row = ring + (size_t)slot*span;
+                if (y < 0 || y >= im.h) memset(row + pad, 0, im.w*sizeof(float));
+                else widen_pixels(im.type, image_ptr(im, 0, y, im_c), im.step, row + pad, im.w);
+                cached[slot] = y;
+            }
 
-                
+            for (int w = 0; w < im.w; w++) 
+            {
                 float sum = 0;
                 for (int fc = 0; fc < filter.c; fc++) 
                 {
                     for (int fh = 0; fh < filter.h; fh++) 
                     {
+                        int y = h + fh - filter.h / 2;
+                        const float *row = ring + (size_t)(((y % filter.h) + filter.h) % filter.h)*span + w;
+                        const float *tap = taps + (fc*filter.h + fh)*filter.w;
                         for (int fw = 0; fw < filter.w; fw++) 
                         {
-                            int im_c = preserve ? c : 0;
-                            int im_h = h + fh - filter.h / 2;
-                            int im_w = w + fw - filter.w / 2;
-                            
-                            float im_val = get_pixel(im, im_w, im_h, im_c);
-                            float filter_val = get_pixel(filter, fw, fh, fc);
-                            
-                            sum = sum + (im_val * filter_val);
+                            sum = sum + (row[fw] * tap[fw]);
                         }
                     }
                 }
-                
-                set_pixel(new_image, w, h, c, sum);
-
-                
+                out[w] = sum;
             }
+            narrow_pixels(new_image.type, image_ptr(new_image, 0, h, c), new_image.step, out, im.w);
         }
     }
-
-    return new_image;
+    free(taps);
+    free(cached);
+    free(ring);
 }
 
 image make_highpass_filter()
@@ -196,47 +241,54 @@ image make_gaussian_filter(float sigma)
     return filter;
 }
 
-image add_image(image a, image b)
+// out = a op b element for element. out may be a or b, each element is
+// read before it is written.
+#define BINARY_OP_INTO(a, b, out, OP) do { \
+    assert((a).w == (b).w && (a).h == (b).h && (a).c == (b).c); \
+    assert((out).w == (a).w && (out).h == (a).h && (out).c == (a).c); \
+    assert((a).type == IMAGE_F32 && (b).type == IMAGE_F32 && (out).type == IMAGE_F32); \
+    image fa = flatten_channels(a), fb = flatten_channels(b), fo = flatten_channels(out); \
+    /* Same shape, so the rows line up element for element. Mixed layouts \
+       fall back to per pixel steps. */ \
+    if (fa.w != fb.w || fa.w != fo.w || fa.step != 1 || fb.step != 1) \
+    { \
+        fa = (a); fb = (b); fo = (out); \
+    } \
+    for (int c = 0; c < fa.c; c++) \
+    { \
+        for (int h = 0; h < fa.h; h++) \
+        { \
+            const float *ra = image_row(fa, h, c), *rb = image_row(fb, h, c); \
+            float *ro = image_row(fo, h, c); \
+            if (fa.step == 1 && fb.step == 1 && fo.step == 1) \
+                for (int w = 0; w < fa.w; w++) ro[w] = ra[w] OP rb[w]; \
+            else \
+                for (int w = 0; w < fa.w; w++) ro[w*fo.step] = ra[w*fa.step] OP rb[w*fb.step]; \
+        } \
+    } \
+} while (0)
+
+void add_image_into(image a, image b, image out)
 {
-    assert(a.w == b.w && a.h == b.h && a.c == b.c);
-
-    image new_image = make_image(a.w, a.h, a.c);
+    BINARY_OP_INTO(a, b, out, +);
+}
 
-    for (int c = 0; c < a.c; c++) 
-    {
-        for (int h = 0; h < a.h; h++) 
-        {
-            for (int w = 0; w < a.w; w++) 
-            {
-                float value_1 = get_pixel(a, w, h, c);
-                float value_2 = get_pixel(b, w, h, c);
-                set_pixel(new_image, w, h, c, value_1 + value_2);
-            }
-        }
-    }
+void sub_image_into(image a, image b, image out)
+{
+    BINARY_OP_INTO(a, b, out, -);
+}
 
+image add_image(image a, image b)
+{
+    image new_image = make_image_uninit_layout(a.w, a.h, a.c, a.layout);
+    add_image_into(a, b, new_image);
     return new_image;
 }
 
 image sub_image(image a, image b)
 {
-    assert(a.w == b.w && a.h == b.h && a.c == b.c);
-
-    image new_image = make_image(a.w, a.h, a.c);
-
-    for (int c = 0; c < a.c; c++) 
-    {
-        for (int h = 0; h < a.h; h++) 
-        {
-            for (int w = 0; w < a.w; w++) 
-            {
-                float value_1 = get_pixel(a, w, h, c);
-                float value_2 = get_pixel(b, w, h, c);
-                set_pixel(new_image, w, h, c, value_1 - value_2);
-            }
-        }
-    }
-
+    image new_image = make_image_uninit_layout(a.w, a.h, a.c, a.layout);
+    sub_image_into(a, b, new_image);
     return new_image;
 }
 
@@ -344,8 +396,8 @@ void feature_normalize(image im)
 image *sobel_image(image im)
 {
     image *new_image = calloc(2, sizeof(image));
-    new_image[0] = make_image(im.w, im.h, 1); // Gradient magnitude
-    new_image[1] = make_image(im.w, im.h, 1); // Gradient direction
+    new_image[0] = make_image_uninit(im.w, im.h, 1); // Gradient magnitude
+    new_image[1] = make_image_uninit(im.w, im.h, 1); // Gradient direction
 
     image gx_filter = make_gx_filter();
     image gy_filter = make_gy_filter();
@@ -385,19 +437,23 @@ image colorize_sobel(image im)
 
     feature_normalize(magnitude); // Normalize gradient magnitude
 
+    // Fully saturated, full value colours so hsv_to_rgb gets three channels
+    image colors = make_image(im.w, im.h, 3);
     for (int h = 0; h < im.h; ++h) 
     {
         for (int w = 0; w < im.w; ++w) 
         {
             float mag_val = get_pixel(magnitude, w, h, 0);
-            float hue = (1 - mag_val) * 240; // Map magnitude to hue range (blue to red)
-            set_pixel(magnitude, w, h, 0, hue);
+            float hue = (1 - mag_val) * 240 / 360; // Map magnitude to hue range (blue to red)
+            set_pixel(colors, w, h, 0, hue);
+            set_pixel(colors, w, h, 1, 1);
+            set_pixel(colors, w, h, 2, 1);
         }
     }
 
-    hsv_to_rgb(magnitude);
+    hsv_to_rgb(colors);
 
-    image result = make_image(im.w, im.h, im.c);
+    image result = make_image_uninit(im.w, im.h, im.c);
 
     for (int c = 0; c < im.c; c++)
      {
@@ -405,13 +461,15 @@ image colorize_sobel(image im)
         {
             for (int w = 0; w < im.w; w++) 
             {
-                float hue_val = get_pixel(magnitude, w, h, 0);
+                float hue_val = get_pixel(colors, w, h, c < 3 ? c : 0);
                 float im_val = get_pixel(im, w, h, c);
                 set_pixel(result, w, h, c, hue_val * im_val);
             }
         }
     }
 
+    free_image(magnitude);
+    free_image(colors);
     free_image(grad[0]);
     free_image(grad[1]);
     free(grad);
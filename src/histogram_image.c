@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "image.h"
+
+// Interleaved sub-histograms per thread: consecutive pixels land in
+// different copies, so runs of equal values don't serialize on
+// store-to-load forwarding of the same counter
+#define HIST_WAYS 4
+// Pixels whose bins are computed at once before counting
+#define HIST_BLOCK 256
+
+static inline int hist_bin(float v, float lo, float scale, int bins)
+{
+    int b = (int)((v - lo) * scale);
+    return b < 0 ? 0 : (b >= bins ? bins - 1 : b);
+}
+
+static void bin_block(const float *restrict x, int n, float lo, float scale, int bins, int *restrict out)
+{
+    for (int i = 0; i < n; i++)
+    {
+        float b = (x[i] - lo) * scale;
+        b = b < 0 ? 0 : (b > bins - 1 ? bins - 1 : b);
+        out[i] = (int)b;
+    }
+}
+
+// Counts channel c of im into counts[bins]
+static void count_plane(image im, int c, float lo, float hi, int bins, uint64_t *counts)
+{
+    float scale = bins / (hi - lo);
+    #pragma omp parallel
+    {
+        uint64_t *local = calloc(HIST_WAYS*bins, sizeof(uint64_t));
+        int idx[HIST_BLOCK];
+
+        #pragma omp for
+        for (int y = 0; y < im.h; y++)
+        for (int start = 0; start < im.w; start += HIST_BLOCK)
+        {
+            int len = (start + HIST_BLOCK < im.w) ? HIST_BLOCK : im.w - start;
+            bin_block(image_row(im, y, c) + start, len, lo, scale, bins, idx);
+            int i = 0;
+            for (; i + HIST_WAYS <= len; i += HIST_WAYS)
+            {
+                local[0*bins + idx[i+0]]++;
+                local[1*bins + idx[i+1]]++;
+                local[2*bins + idx[i+2]]++;
+                local[3*bins + idx[i+3]]++;
+            }
+            for (; i < len; i++) local[idx[i]]++;
+        }
+
+        for (int b = 0; b < bins; b++)
+        {
+            uint64_t sum = 0;
+            for (int k = 0; k < HIST_WAYS; k++) sum += local[k*bins + b];
+            local[b] = sum;
+        }
+        #pragma omp critical
+        for (int b = 0; b < bins; b++) counts[b] += local[b];
+        free(local);
+    }
+}
+
+histogram make_histogram(image im, int bins, float lo, float hi)
+{
+    assert(bins > 0 && hi > lo);
+    assert(im.layout == LAYOUT_CHW && im.type == IMAGE_F32);
+    histogram h;
+    h.bins = bins;
+    h.c = im.c;
+    h.lo = lo;
+    h.hi = hi;
+    h.counts = calloc((size_t)im.c*bins, sizeof(uint64_t));
+    for (int c = 0; c < im.c; c++)
+    {
+        count_plane(im, c, lo, hi, bins, h.counts + (size_t)c*bins);
+    }
+    return h;
+}
+
+void free_histogram(histogram h)
+{
+    free(h.counts);
+}
+
+// Equalization LUT from the counts of one channel: the normalized CDF,
+// shifted so the first occupied bin maps to 0
+static void make_equalize_lut(const float *counts, int bins, float *lut)
+{
+    double total = 0, first = 0, cdf = 0;
+    for (int b = 0; b < bins; b++) total += counts[b];
+    for (int b = 0; b < bins && !first; b++) first = counts[b];
+    double norm = (total > first) ? 1. / (total - first) : 0;
+    for (int b = 0; b < bins; b++)
+    {
+        cdf += counts[b];
+        lut[b] = (cdf > first) ? (cdf - first) * norm : 0;
+    }
+}
+
+static void apply_bin_lut(image im, int c, float lo, float hi, int bins, const float *lut)
+{
+    float scale = bins / (hi - lo);
+    #pragma omp parallel for
+    for (int y = 0; y < im.h; y++)
+    {
+        float *row = image_row(im, y, c);
+        for (int x = 0; x < im.w; x++) row[x] = lut[hist_bin(row[x], lo, scale, bins)];
+    }
+}
+
+void equalize_histogram(image im, int bins)
+{
+    assert(image_exclusive(im));
+    histogram h = make_histogram(im, bins, 0, 1);
+    float *counts = calloc(bins, sizeof(float));
+    float *lut = calloc(bins, sizeof(float));
+    for (int c = 0; c < im.c; c++)
+    {
+        for (int b = 0; b < bins; b++) counts[b] = h.counts[c*bins + b];
+        make_equalize_lut(counts, bins, lut);
+        apply_bin_lut(im, c, 0, 1, bins, lut);
+    }
+    free(counts);
+    free(lut);
+    free_histogram(h);
+}
+
+// Clips every bin at limit and spreads the clipped mass evenly over all
+// bins, which keeps the total count of the tile unchanged
+static void clip_histogram(float *counts, int bins, float limit)
+{
+    float excess = 0;
+    for (int b = 0; b < bins; b++)
+    {
+        if (counts[b] > limit)
+        {
+            excess += counts[b] - limit;
+            counts[b] = limit;
+        }
+    }
+    float add = excess / bins;
+    for (int b = 0; b < bins; b++) counts[b] += add;
+}
+
+// Tile t of n pixels split into tiles starts here. Sizes differ by at
+// most one, so no tile is empty as long as tiles <= n.
+static inline int tile_start(int t, int n, int tiles)
+{
+    return (int)((long long)t*n/tiles);
+}
+
+static inline float tile_centre(int t, int n, int tiles)
+{
+    return .5f*(tile_start(t, n, tiles) + tile_start(t + 1, n, tiles));
+}
+
+// For each of n pixels the two tiles whose centres surround it and the
+// blend weight of the second
+static void tile_weights(int n, int tiles, int *i0, int *i1, float *f)
+{
+    int a = 0;
+    for (int x = 0; x < n; x++)
+    {
+        float p = x + .5f;
+        while (a + 1 < tiles && tile_centre(a + 1, n, tiles) <= p) a++;
+        float c0 = tile_centre(a, n, tiles);
+        float w = 0;
+        if (p > c0 && a + 1 < tiles) w = (p - c0) / (tile_centre(a + 1, n, tiles) - c0);
+        i0[x] = a;
+        i1[x] = (a + 1 < tiles) ? a + 1 : a;
+        f[x] = w;
+    }
+}
+
+void clahe_image(image im, int tiles_x, int tiles_y, float clip_limit)
+{
+    assert(tiles_x > 0 && tiles_y > 0);
+    assert(im.layout == LAYOUT_CHW && im.type == IMAGE_F32);
+    assert(image_exclusive(im));
+    const int bins = CLAHE_BINS;
+    // More tiles than pixels would leave some empty
+    if (tiles_x > im.w) tiles_x = im.w;
+    if (tiles_y > im.h) tiles_y = im.h;
+    int ntiles = tiles_x*tiles_y;
+    float scale = (float)bins;
+
+    float *luts = calloc((size_t)ntiles*bins, sizeof(float));
+    int *xi0 = calloc(im.w, sizeof(int)), *xi1 = calloc(im.w, sizeof(int));
+    int *yi0 = calloc(im.h, sizeof(int)), *yi1 = calloc(im.h, sizeof(int));
+    float *xf = calloc(im.w, sizeof(float)), *yf = calloc(im.h, sizeof(float));
+    tile_weights(im.w, tiles_x, xi0, xi1, xf);
+    tile_weights(im.h, tiles_y, yi0, yi1, yf);
+
+    for (int c = 0; c < im.c; c++)
+    {
+
+        // Tile histograms, clipping and LUTs are independent per tile
+        #pragma omp parallel for
+        for (int t = 0; t < ntiles; t++)
+        {
+            int tx = t % tiles_x, ty = t / tiles_x;
+            int x0 = tile_start(tx, im.w, tiles_x), x1 = tile_start(tx + 1, im.w, tiles_x);
+            int y0 = tile_start(ty, im.h, tiles_y), y1 = tile_start(ty + 1, im.h, tiles_y);
+            float counts[CLAHE_BINS] = {0};
+            for (int y = y0; y < y1; y++)
+            {
+                const float *row = image_row(im, y, c);
+                for (int x = x0; x < x1; x++) counts[hist_bin(row[x], 0, scale, bins)]++;
+            }
+            int n = (x1 - x0)*(y1 - y0);
+            float limit = clip_limit * n / bins;
+            if (limit < 1) limit = 1;
+            clip_histogram(counts, bins, limit);
+            make_equalize_lut(counts, bins, luts + (size_t)t*bins);
+        }
+
+        // Every pixel blends the LUTs of the four surrounding tile centres
+        #pragma omp parallel for
+        for (int y = 0; y < im.h; y++)
+        {
+            const float *top0 = luts + (size_t)yi0[y]*tiles_x*bins;
+            const float *bot0 = luts + (size_t)yi1[y]*tiles_x*bins;
+            float fy = yf[y];
+            float *row = image_row(im, y, c);
+            for (int x = 0; x < im.w; x++)
+            {
+                int b = hist_bin(row[x], 0, scale, bins);
+                int a0 = xi0[x]*bins + b, a1 = xi1[x]*bins + b;
+                float fx = xf[x];
+                float top = top0[a0] + fx*(top0[a1] - top0[a0]);
+                float bot = bot0[a0] + fx*(bot0[a1] - bot0[a0]);
+                row[x] = top + fy*(bot - top);
+            }
+        }
+    }
+
+    free(luts);
+    free(xi0); free(xi1); free(xf);
+    free(yi0); free(yi1); free(yf);
+}
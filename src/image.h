@@ -3,42 +3,348 @@
 
 // DO NOT CHANGE THIS FILE
 
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LAYOUT_CHW 0
+#define LAYOUT_HWC 1
+
+// Storage types. U8 holds v*255 rounded, F16 is IEEE half precision.
+#define IMAGE_F32 0
+#define IMAGE_U8 1
+#define IMAGE_F16 2
+
+// Pixel (x, y, c) is element x*step + y*stride + c*plane. Planar (CHW)
+// images have step 1 and planes h*stride apart, interleaved (HWC) ones
+// have step c and plane 1. make_image pads the stride so every row starts
+// 64-byte aligned. stride and plane are size_t so a plane can hold more
+// than 2^31 elements.
+// mem is the allocation the image owns; views into another image leave it
+// 0 so free_image on them does nothing.
 typedef struct{
     int w,h,c;
-    float *data;
+    union{
+        float *data;
+        unsigned char *u8;
+        uint16_t *f16;
+    };
+    int step;
+    size_t stride, plane;
+    int layout, type;
+    void *mem;
 } image;
 
-// Basic operations
+static inline int image_elem_size(int type)
+{
+    return (type == IMAGE_U8) ? 1 : ((type == IMAGE_F16) ? 2 : 4);
+}
+
+// Bytes make_image allocates for im, padding included
+static inline size_t image_bytes(image im)
+{
+    size_t n = (im.layout == LAYOUT_HWC) ? (size_t)im.stride*im.h : (size_t)im.plane*im.c;
+    return n*image_elem_size(im.type);
+}
+
+// Row y of channel c of a float image, its pixels are step floats apart
+static inline float *image_row(image im, int y, int c)
+{
+    return im.data + (size_t)c*im.plane + (size_t)y*im.stride;
+}
+
+// Element (x, y, c) of an image of any type
+static inline void *image_ptr(image im, int x, int y, int c)
+{
+    size_t i = (size_t)c*im.plane + (size_t)y*im.stride + (size_t)x*im.step;
+    return im.u8 + i*image_elem_size(im.type);
+}
+
+// Whether channel k of a c channel image is alpha: the second of gray and
+// alpha, the fourth of RGBA. Alpha is linear whatever the colour encoding.
+static inline int is_alpha_channel(int c, int k)
+{
+    return (c == 2 && k == 1) || (c == 4 && k == 3);
+}
+
+// Interleaved images with nothing between pixels are rows of w*c floats.
+// Kernels that treat every channel alike can walk them as one channel of
+// that width.
+static inline image flatten_channels(image im)
+{
+    if (im.layout == LAYOUT_HWC && im.step == im.c && im.plane == 1)
+    {
+        im.w *= im.c;
+        im.c = 1;
+        im.step = 1;
+    }
+    return im;
+}
+
+#define RESIZE_NN 0
+#define RESIZE_BILINEAR 1
+
+// Precomputed source taps for resizing between two fixed sizes.
+// Each output column (row) reads two source columns (rows) with weights,
+// rows is scratch for two resampled rows plus a staged output and source
+// row for compact storage types, so executing never allocates.
+typedef struct{
+    int src_w, src_h, dst_w, dst_h, method;
+    int *xi, *yi;
+    float *xw, *yw;
+    float *rows;
+} resize_plan;
+
+#define REMAP_FLOAT 0
+#define REMAP_FIXED 1
+#define REMAP_BITS 5
+
+// A float image kept in a scratch file instead of memory, for images
+// bigger than RAM. It is stored as planar tile x tile blocks (clipped at
+// the right and bottom edges); at most max_resident of them are mapped
+// at once and the least recently used one is unmapped to make room.
+typedef struct tile_cache tile_cache;
+typedef struct{
+    int w, h, c;
+    int tile, tiles_x, tiles_y;
+    tile_cache *cache;
+} tiled_image;
+
+// Called with each tile of a tiled image and the position of its corner
+typedef void (*tile_fn)(image tile, int x, int y, void *ctx);
+
+// Per output pixel source coordinates for remap_image. REMAP_FLOAT keeps
+// them as floats, REMAP_FIXED packs the integer column and row as shorts
+// plus REMAP_BITS of subpixel fraction for each axis in frac. Only the
+// maps are precomputed: applying one is still a scalar gather per pixel
+// with a bounds check, which doesn't vectorize without gather loads.
+typedef struct{
+    int w, h, type;
+    float *x, *y;
+    short *xy;
+    unsigned short *frac;
+} remap_map;
+
+typedef void (*remap_fn)(float x, float y, float *sx, float *sy, void *ctx);
+
+#define POINT_AFFINE 0
+#define POINT_CLAMP 1
+#define POINT_GAMMA 2
+#define POINT_THRESHOLD 3
+
+// One point-wise op on channel c (or every channel when c < 0).
+// AFFINE is x*a + b, CLAMP is [a, b], GAMMA is x^a, THRESHOLD is x > a.
+typedef struct{
+    int type, c;
+    float a, b;
+} point_op;
+
+// A chain of point-wise ops that apply_point_ops runs in one fused pass
+typedef struct{
+    int n, cap;
+    point_op *ops;
+} point_ops;
+
+// Intensity bins of the per tile histograms in clahe_image
+#define CLAHE_BINS 256
+
+// Per channel histogram of bins equal bins over [lo, hi); values outside
+// the range are counted in the first or last bin. Counts are 64-bit, a
+// flat gigapixel plane puts more than 2^32 pixels in one bin.
+typedef struct{
+    int bins, c;
+    float lo, hi;
+    uint64_t *counts;
+} histogram;
+
+// A 3D colour lookup table of size^3 RGB entries, red varying fastest.
+// Each entry is padded to LUT_STRIDE floats so it is one aligned load.
+// Inputs are mapped from [domain_min, domain_max] onto the lattice.
+// Applying one costs about as much as a single colour space round trip,
+// so it pays off for chains longer than that.
+#define LUT_STRIDE 4
+#define LUT_MAX_SIZE 256
+typedef struct{
+    int size;
+    float *data;
+    float domain_min[3], domain_max[3];
+} color_lut;
+
+typedef void (*lut_fn)(image im, void *ctx);
+
+// Works on n pixels of red, green and blue held in three arrays
+typedef void (*rgb_block_fn)(float *r, float *g, float *b, int n, void *ctx);
+
+// A full image pyramid sharing one contiguous allocation.
+// levels[0] is a copy of the source, each further level is half the size.
+typedef struct{
+    int n;
+    image *levels;
+    float *data;
+} image_pyramid;
+
+// Basic operations. The _into variants write the result into a caller
+// provided image of the right size instead of allocating one.
 float get_pixel(image im, int x, int y, int c);
 void set_pixel(image im, int x, int y, int c, float v);
 image copy_image(image im);
+void copy_image_into(image im, image out);
+// Views borrow im's pixels without a reference, see image_exclusive
+image view_image(image im, int x, int y, int w, int h);
+image view_channels(image im, int c, int n);
+image to_planar(image im);
+image to_interleaved(image im);
+void for_each_rgb_block(image im, rgb_block_fn fn, void *ctx);
+void premultiply_alpha(image im);
+void unpremultiply_alpha(image im);
 image rgb_to_grayscale(image im);
+void rgb_to_grayscale_into(image im, image gray);
+void rgb_to_grayscale_u8(const unsigned char *src, int c, unsigned char *gray, int n);
 image grayscale_to_rgb(image im, float r, float g, float b);
 void rgb_to_hsv(image im);
 void hsv_to_rgb(image im);
+void rgb_to_ycbcr(image im);
+void ycbcr_to_rgb(image im);
+// Lab is out of [0,1], so it needs F32 or F16 storage. RGB is taken as
+// sRGB encoded, or as linear when linear light is on.
+void rgb_to_lab(image im);
+void lab_to_rgb(image im);
 void shift_image(image im, int c, float v);
 void scale_image(image im, int c, float v);
 void clamp_image(image im);
 image get_channel(image im, int c);
+point_ops make_point_ops();
+void add_point_affine(point_ops *p, int c, float scale, float shift);
+void add_point_clamp(point_ops *p, int c, float lo, float hi);
+void add_point_gamma(point_ops *p, int c, float gamma);
+void add_point_threshold(point_ops *p, int c, float thresh);
+void apply_point_ops(image im, point_ops p);
+void free_point_ops(point_ops p);
 int same_image(image a, image b);
 image sub_image(image a, image b);
 image add_image(image a, image b);
+void sub_image_into(image a, image b, image out);
+void add_image_into(image a, image b, image out);
 
 // Loading and saving
+image make_empty_image(int w, int h, int c);
 image make_image(int w, int h, int c);
+image make_image_uninit(int w, int h, int c);
+image make_image_layout(int w, int h, int c, int layout);
+image make_image_uninit_layout(int w, int h, int c, int layout);
+image make_image_typed(int w, int h, int c, int type);
+image make_image_uninit_typed(int w, int h, int c, int layout, int type);
+// Whether a w x h x c image of layout and type can be allocated without
+// its byte count overflowing
+int image_size_ok(int w, int h, int c, int layout, int type);
 image load_image(char *filename);
+image load_image_layout(char *filename, int layout);
+image load_image_rgba(char *filename);
+image load_image_resized(char *filename, int w, int h);
+void set_linear_light(int on);
+int get_linear_light();
+float srgb8_to_linear(unsigned char v);
+unsigned char linear_to_srgb8(float v);
 void save_image(image im, const char *name);
 void save_png(image im, const char *name);
 void free_image(image im);
+image share_image(image im);
+void make_writable(image *im);
+
+// Image buffer pool, make_image and free_image go through it. Blocks are
+// reference counted, pool_free returns one once the last reference goes.
+void *pool_alloc(size_t size);
+void pool_retain(void *p);
+int pool_refs(void *p);
+void pool_free(void *p);
+void set_image_pool_limit(size_t bytes);
+
+// In place operations need the only reference to im's pixels, see
+// make_writable. Views own nothing and always pass, so a view of a shared
+// image is not caught: writes through it show in every handle. Call
+// make_writable on the parent before taking views to write through.
+static inline int image_exclusive(image im)
+{
+    return !im.mem || pool_refs(im.mem) <= 1;
+}
+void clear_image_pool();
+
+// Storage types
+float half_to_float(uint16_t h);
+uint16_t float_to_half(float f);
+void widen_pixels(int type, const void *src, int step, float *out, int n);
+void narrow_pixels(int type, void *dst, int step, const float *in, int n);
+void widen_row(image im, int y, int c, float *out);
+void narrow_row(image im, int y, int c, const float *in);
+image convert_image(image im, int type);
 
 // Resizing
 float nn_interpolate(image im, float x, float y, int c);
 image nn_resize(image im, int w, int h);
+void nn_resize_into(image im, image out);
 float bilinear_interpolate(image im, float x, float y, int c);
 image bilinear_resize(image im, int w, int h);
+void bilinear_resize_into(image im, image out);
+resize_plan make_resize_plan(int src_w, int src_h, int dst_w, int dst_h, int method);
+void resize_with_plan(resize_plan p, image src, image dst);
+void resize_u8_with_plan(resize_plan p, const unsigned char *src, int src_c, const float *decode, image dst);
+void free_resize_plan(resize_plan p);
+// Frees the calling thread's cached plan, e.g. before the thread exits
+void free_resize_cache();
+
+// Tiled images. Tiles from acquire_tile stay mapped until released.
+// The scratch file goes in the directory given to set_tile_scratch_dir,
+// else $TMPDIR, else /tmp. Those are often tmpfs, i.e. RAM and swap, so
+// point it at a disk for images that really don't fit in memory.
+void set_tile_scratch_dir(const char *dir);
+tiled_image make_tiled_image(int w, int h, int c, int tile, int max_resident);
+void free_tiled_image(tiled_image t);
+image acquire_tile(tiled_image t, int tx, int ty);
+void release_tile(tiled_image t, int tx, int ty);
+void for_each_tile(tiled_image t, tile_fn fn, void *ctx);
+void read_tiled_region(tiled_image t, int x, int y, image out);
+void write_tiled_region(tiled_image t, int x, int y, image in);
+tiled_image tile_image(image im, int tile, int max_resident);
+image untile_image(tiled_image t);
+void convolve_tiled(tiled_image im, image filter, int preserve, tiled_image out);
+void resize_tiled(tiled_image im, tiled_image out, int method);
+
+// Warping, m maps source coordinates to destination coordinates
+int invert_affine(const float m[6], float inv[6]);
+void make_rotation_affine(float m[6], float theta, float cx, float cy);
+void make_shear_affine(float m[6], float kx, float ky);
+image warp_affine(image im, const float m[6], int w, int h, int method, float fill);
+image rotate_image(image im, float theta, int method);
+
+// Remapping
+remap_map make_remap(int w, int h, remap_fn fn, void *ctx, int type);
+remap_map make_undistort_remap(int w, int h, float k1, float k2, int type);
+void remap_image(image src, image dst, remap_map map);
+void free_remap(remap_map map);
+
+// Histograms
+histogram make_histogram(image im, int bins, float lo, float hi);
+void free_histogram(histogram h);
+void equalize_histogram(image im, int bins);
+void clahe_image(image im, int tiles_x, int tiles_y, float clip_limit);
+
+// Colour lookup tables
+color_lut make_color_lut(int size);
+color_lut bake_color_lut(int size, lut_fn fn, void *ctx);
+color_lut load_cube_lut(const char *filename);
+void apply_color_lut(image im, color_lut lut);
+void free_color_lut(color_lut lut);
+
+// Pyramids
+image_pyramid make_image_pyramid(image im, int levels);
+void free_image_pyramid(image_pyramid p);
 
 // Filtering
 image convolve_image(image im, image filter, int preserve);
+void convolve_image_into(image im, image filter, int preserve, image out);
 image make_box_filter(int w);
 image make_highpass_filter();
 image make_sharpen_filter();
@@ -51,5 +357,9 @@ void threshold_image(image im, float thresh);
 image *sobel_image(image im);
 image colorize_sobel(image im);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
 
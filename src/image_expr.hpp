@@ -0,0 +1,134 @@
+#ifndef IMAGE_EXPR_HPP
+#define IMAGE_EXPR_HPP
+
+// Lazy image arithmetic for C++11 callers.
+//
+//     using namespace uwimg;
+//     image out = eval(a + (b - c) * 0.5f);
+//     assign(a, a - lfreq);
+//
+// Operators only build a small expression tree; eval / assign walk it once
+// per pixel, a row at a time in loops the compiler can vectorize, so no
+// temporary images are allocated. Every image in an expression must have the same
+// shape. assign may write into one of its own operands.
+//
+// image is a C struct in the global namespace, so argument dependent lookup
+// only finds the operators once an operand is an expression node. Bring
+// them into scope where images are combined directly.
+
+#include <cassert>
+#include <type_traits>
+#include "image.h"
+
+namespace uwimg {
+
+struct shape {
+    int w, h, c;
+    bool any() const { return w < 0; }
+};
+
+template <class E>
+struct expr {
+    const E &self() const { return static_cast<const E &>(*this); }
+};
+
+// Nodes are indexed by (c, y, x) so views and padded rows work as operands
+struct image_ref : expr<image_ref> {
+    image im;
+    shape s;
+    image_ref(const image &im) : im(im), s{im.w, im.h, im.c} { assert(im.type == IMAGE_F32); }
+    float operator()(int c, int y, int x) const { return image_row(im, y, c)[x*im.step]; }
+    shape get_shape() const { return s; }
+};
+
+struct scalar : expr<scalar> {
+    float v;
+    scalar(float v) : v(v) {}
+    float operator()(int, int, int) const { return v; }
+    shape get_shape() const { return shape{-1, -1, -1}; }
+};
+
+struct add_op { static float apply(float a, float b) { return a + b; } };
+struct sub_op { static float apply(float a, float b) { return a - b; } };
+struct mul_op { static float apply(float a, float b) { return a * b; } };
+struct div_op { static float apply(float a, float b) { return a / b; } };
+
+template <class L, class R, class Op>
+struct binary : expr<binary<L, R, Op>> {
+    L l;
+    R r;
+    binary(const L &l, const R &r) : l(l), r(r) {}
+    float operator()(int c, int y, int x) const { return Op::apply(l(c, y, x), r(c, y, x)); }
+    shape get_shape() const {
+        shape a = l.get_shape(), b = r.get_shape();
+        assert(a.any() || b.any() || (a.w == b.w && a.h == b.h && a.c == b.c));
+        return a.any() ? b : a;
+    }
+};
+
+// Leaves are stored by value: images as the image struct, scalars as floats
+template <class T> struct leaf { typedef T type; };
+template <> struct leaf<image> { typedef image_ref type; };
+template <> struct leaf<float> { typedef scalar type; };
+
+// Images and expression nodes; plain floats only mix in as scalars
+template <class T>
+struct is_operand : std::integral_constant<bool,
+    std::is_same<T, image>::value || std::is_base_of<expr<T>, T>::value> {};
+
+template <class L, class R, class Op>
+struct make_binary {
+    typedef binary<typename leaf<L>::type, typename leaf<R>::type, Op> type;
+};
+
+#define UWIMG_OPERATOR(SYM, OP) \
+    template <class L, class R> \
+    typename std::enable_if<is_operand<L>::value && is_operand<R>::value, typename make_binary<L, R, OP>::type>::type \
+    operator SYM(const L &l, const R &r) { return typename make_binary<L, R, OP>::type(l, r); } \
+    template <class L> \
+    typename std::enable_if<is_operand<L>::value, typename make_binary<L, float, OP>::type>::type \
+    operator SYM(const L &l, float r) { return typename make_binary<L, float, OP>::type(l, r); } \
+    template <class R> \
+    typename std::enable_if<is_operand<R>::value, typename make_binary<float, R, OP>::type>::type \
+    operator SYM(float l, const R &r) { return typename make_binary<float, R, OP>::type(l, r); }
+
+UWIMG_OPERATOR(+, add_op)
+UWIMG_OPERATOR(-, sub_op)
+UWIMG_OPERATOR(*, mul_op)
+UWIMG_OPERATOR(/, div_op)
+
+#undef UWIMG_OPERATOR
+
+// Evaluates e into dst in one pass
+template <class E>
+void assign(image dst, const E &e)
+{
+    const typename leaf<E>::type &x = e;
+    shape s = x.get_shape();
+    assert(s.any() || (s.w == dst.w && s.h == dst.h && s.c == dst.c));
+    assert(dst.type == IMAGE_F32);
+    for (int c = 0; c < dst.c; c++)
+    {
+        for (int y = 0; y < dst.h; y++)
+        {
+            float *out = image_row(dst, y, c);
+            for (int i = 0; i < dst.w; i++) out[i*dst.step] = x(c, y, i);
+        }
+    }
+}
+
+// Evaluates e into a newly allocated image
+template <class E>
+image eval(const E &e)
+{
+    const typename leaf<E>::type &x = e;
+    shape s = x.get_shape();
+    assert(!s.any());
+    image out = make_image_uninit(s.w, s.h, s.c);
+    assign(out, x);
+    return out;
+}
+
+} // namespace uwimg
+
+#endif
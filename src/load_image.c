@@ -1,6 +1,8 @@
 // You probably don't want to edit this file
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 
 #include "image.h"
 
@@ -11,29 +13,195 @@ image make_empty_image(int w, int h, int c)
     out.h = h;
     out.w = w;
     out.c = c;
+    out.step = 1;
+    out.stride = w;
+    out.plane = (size_t)w*h;
+    out.layout = LAYOUT_CHW;
+    out.type = IMAGE_F32;
+    out.mem = 0;
     return out;
 }
 
-image make_image(int w, int h, int c)
+// Rows are padded to whole 64-byte lines. A pitch that is a multiple of
+// 1KB puts vertically adjacent pixels in the same few cache sets and makes
+// loads alias stores 4KB apart, so such rows get one extra line. Planes
+// that land on a 4KB multiple are padded by a line the same way, or the
+// same pixel in each channel aliases.
+#define ROW_ALIGN 64
+#define PLANE_ALIAS 4096
+
+// Row stride in elements of size bytes
+static size_t padded_stride(size_t w, int size)
+{
+    size_t align = ROW_ALIGN/size;
+    size_t stride = (w + align - 1) / align * align;
+    if (stride*size >= 1024 && stride*size % 1024 == 0) stride += align;
+    return stride;
+}
+
+// Plane size in elements of size bytes for h rows of stride
+static size_t padded_plane(size_t stride, int h, int size)
+{
+    size_t plane = stride*h;
+    if (plane*size % PLANE_ALIAS == 0) plane += ROW_ALIGN/size;
+    return plane;
+}
+
+// The padded stride and plane alloc_image gives a w x h x c image, or 0
+// if its buffer can't be addressed. Each product is checked before it
+// is formed.
+static int image_geometry(int w, int h, int c, int layout, int size, size_t *stride, size_t *plane)
+{
+    size_t row = w, n;
+    if (w < 0 || h < 0 || c < 0) return 0;
+    if (layout == LAYOUT_HWC && __builtin_mul_overflow((size_t)w, (size_t)c, &row)) return 0;
+    // Room for the row padding
+    if (row > SIZE_MAX/size - 2*ROW_ALIGN) return 0;
+    *stride = padded_stride(row, size);
+    if (__builtin_mul_overflow(*stride, (size_t)h, &n)) return 0;
+    if (layout == LAYOUT_HWC) {
+        *plane = 1;
+    } else {
+        // And for the plane padding
+        if (n > SIZE_MAX/size - ROW_ALIGN) return 0;
+        *plane = padded_plane(*stride, h, size);
+        if (__builtin_mul_overflow(*plane, (size_t)c, &n)) return 0;
+    }
+    if (__builtin_mul_overflow(n, (size_t)size, &n)) return 0;
+    return n <= SIZE_MAX/2;
+}
+
+int image_size_ok(int w, int h, int c, int layout, int type)
+{
+    size_t stride, plane;
+    return image_geometry(w, h, c, layout, image_elem_size(type), &stride, &plane);
+}
+
+// Pixels come from the buffer pool and are left as they are
+static image alloc_image(int w, int h, int c, int layout, int type)
 {
     image out = make_empty_image(w,h,c);
-    out.data = calloc(h*w*c, sizeof(float));
+    out.layout = layout;
+    out.type = type;
+    if (!image_geometry(w, h, c, layout, image_elem_size(type), &out.stride, &out.plane)) {
+        fprintf(stderr, "Cannot make a %d x %d x %d image: size overflows\n", w, h, c);
+        exit(1);
+    }
+    if (layout == LAYOUT_HWC) out.step = c;
+    out.data = pool_alloc(image_bytes(out));
+    if (!out.data) {
+        fprintf(stderr, "Cannot allocate a %d x %d x %d image (%zu bytes)\n", w, h, c, image_bytes(out));
+        exit(1);
+    }
+    out.mem = out.data;
+    return out;
+}
+
+// For callers that overwrite every pixel anyway
+image make_image_uninit_layout(int w, int h, int c, int layout)
+{
+    return alloc_image(w,h,c,layout,IMAGE_F32);
+}
+
+image make_image_layout(int w, int h, int c, int layout)
+{
+    image out = alloc_image(w,h,c,layout,IMAGE_F32);
+    if (out.data) memset(out.data, 0, image_bytes(out));
+    return out;
+}
+
+// Planar image stored as type, zeroed
+image make_image_typed(int w, int h, int c, int type)
+{
+    image out = alloc_image(w,h,c,LAYOUT_CHW,type);
+    if (out.data) memset(out.data, 0, image_bytes(out));
     return out;
 }
 
+image make_image_uninit_typed(int w, int h, int c, int layout, int type)
+{
+    return alloc_image(w,h,c,layout,type);
+}
+
+image make_image_uninit(int w, int h, int c)
+{
+    return make_image_uninit_layout(w,h,c,LAYOUT_CHW);
+}
+
+image make_image(int w, int h, int c)
+{
+    return make_image_layout(w,h,c,LAYOUT_CHW);
+}
+
+// Linear-light mode: 8-bit files are decoded from sRGB into linear light
+// through a 256 entry table and encoded back on save through a 4096 entry
+// table over [0,1]. The encode table is fine enough that all 256 codes
+// survive a decode / encode round trip.
+#define SRGB_ENCODE_SIZE 4096
+
+static int linear_light = 0;
+static float srgb_decode_table[256];
+static unsigned char srgb_encode_table[SRGB_ENCODE_SIZE];
+
+void set_linear_light(int on)
+{
+    if (on && !linear_light) {
+        int i;
+        for(i = 0; i < 256; ++i){
+            float v = i/255.;
+            srgb_decode_table[i] = (v <= .04045f) ? v/12.92f : powf((v + .055f)/1.055f, 2.4f);
+        }
+        for(i = 0; i < SRGB_ENCODE_SIZE; ++i){
+            float v = (float)i/(SRGB_ENCODE_SIZE - 1);
+            float s = (v <= .0031308f) ? v*12.92f : 1.055f*powf(v, 1/2.4f) - .055f;
+            srgb_encode_table[i] = (unsigned char) roundf(255*s);
+        }
+    }
+    linear_light = on;
+}
+
+int get_linear_light()
+{
+    return linear_light;
+}
+
+float srgb8_to_linear(unsigned char v)
+{
+    if (!linear_light) return v/255.;
+    return srgb_decode_table[v];
+}
+
+unsigned char linear_to_srgb8(float v)
+{
+    int i = (int)(v*(SRGB_ENCODE_SIZE - 1) + .5f);
+    i = (i < 0) ? 0 : ((i >= SRGB_ENCODE_SIZE) ? SRGB_ENCODE_SIZE - 1 : i);
+    return srgb_encode_table[i];
+}
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
-void save_image_stb(image im, const char *name, int png)
+static void write_image_stb(image im, const char *name, int png)
 {
     char buff[256];
-    unsigned char *data = calloc(im.w*im.h*im.c, sizeof(char));
-    int i,k;
-    for(k = 0; k < im.c; ++k){
-        for(i = 0; i < im.w*im.h; ++i){
-            data[i*im.c+k] = (unsigned char) roundf((255*im.data[i + k*im.w*im.h]));
+    unsigned char *data = calloc((size_t)im.w*im.h*im.c, sizeof(char));
+    int i,j,k;
+    // Packed interleaved rows already match stb's layout and convert
+    // straight through; anything else is transposed channel by channel.
+    // Alpha must be told apart from colour to skip the sRGB encode.
+    image flat = (linear_light && (im.c == 2 || im.c == 4)) ? im : flatten_channels(im);
+    int n = (flat.c == im.c) ? im.c : 1;
+    for(k = 0; k < flat.c; ++k){
+        for(j = 0; j < im.h; ++j){
+            const float *row = image_row(flat, j, k);
+            unsigned char *out = data + (size_t)j*im.w*im.c + k;
+            if(linear_light && !is_alpha_channel(im.c, k)){
+                for(i = 0; i < flat.w; ++i) out[i*n] = linear_to_srgb8(row[i*flat.step]);
+            } else {
+                for(i = 0; i < flat.w; ++i) out[i*n] = (unsigned char) roundf(255*row[i*flat.step]);
+            }
         }
     }
     int success = 0;
@@ -48,6 +216,20 @@ void save_image_stb(image im, const char *name, int png)
     if(!success) fprintf(stderr, "Failed to write image %s\n", buff);
 }
 
+void save_image_stb(image im, const char *name, int png)
+{
+    // Files hold 8-bit values with straight alpha, so compact types are
+    // widened and premultiplied RGBA is divided back out on a copy
+    if(im.type != IMAGE_F32 || im.c == 4){
+        image f = convert_image(im, IMAGE_F32);
+        if(f.c == 4) unpremultiply_alpha(f);
+        write_image_stb(f, name, png);
+        free_image(f);
+        return;
+    }
+    write_image_stb(im, name, png);
+}
+
 void save_png(image im, const char *name)
 {
     save_image_stb(im, name, 1);
@@ -62,41 +244,116 @@ void save_image(image im, const char *name)
 // Load an image using stb
 // channels = [0..4]
 // channels > 0 forces the image to have that many channels
+// Alpha is dropped unless channels is 4, then it is kept and the colour
+// channels are premultiplied by it
+// LAYOUT_HWC keeps stb's interleaved order, so rows convert without a
+// transpose
 //
-image load_image_stb(char *filename, int channels)
+image load_image_stb(char *filename, int channels, int layout)
 {
     int w, h, c;
     unsigned char *data = stbi_load(filename, &w, &h, &c, channels);
     if (!data) {
         fprintf(stderr, "Cannot load image \"%s\"\nSTB Reason: %s\n",
             filename, stbi_failure_reason());
-        exit(0);
+        exit(1);
     }
     if (channels) c = channels;
+    // Dropped alpha is skipped while copying, so only the planes kept are
+    // allocated. Kept alpha is linear, never sRGB decoded.
+    int oc = (c == 4 && channels != 4) ? 3 : c;
     int i,j,k;
-    image im = make_image(w, h, c);
-    for(k = 0; k < c; ++k){
+    image im;
+    if (layout == LAYOUT_HWC) {
+        im = make_image_uninit_layout(w, h, oc, LAYOUT_HWC);
         for(j = 0; j < h; ++j){
+            float *row = image_row(im, j, 0);
+            const unsigned char *src = data + (size_t)c*w*j;
             for(i = 0; i < w; ++i){
-                int dst_index = i + w*j + w*h*k;
-                int src_index = k + c*i + c*w*j;
-                im.data[dst_index] = (float)data[src_index]/255.;
+                for(k = 0; k < oc; ++k){
+                    unsigned char v = src[c*i + k];
+                    row[oc*i + k] = (linear_light && !is_alpha_channel(c, k)) ? srgb_decode_table[v] : (float)v/255.;
+                }
+            }
+        }
+    } else {
+        im = make_image_uninit(w, h, oc);
+        for(k = 0; k < oc; ++k){
+            for(j = 0; j < h; ++j){
+                float *row = image_row(im, j, k);
+                for(i = 0; i < w; ++i){
+                    size_t src_index = k + c*i + (size_t)c*w*j;
+                    row[i] = (linear_light && !is_alpha_channel(c, k)) ? srgb_decode_table[data[src_index]] : (float)data[src_index]/255.;
+                }
             }
         }
     }
-    //We don't like alpha channels, #YOLO
-    if(im.c == 4) im.c = 3;
+    if (oc == 4) premultiply_alpha(im);
     free(data);
     return im;
 }
 
 image load_image(char *filename)
 {
-    image out = load_image_stb(filename, 0);
+    image out = load_image_stb(filename, 0, LAYOUT_CHW);
     return out;
 }
 
+image load_image_layout(char *filename, int layout)
+{
+    return load_image_stb(filename, 0, layout);
+}
+
+// RGBA with premultiplied alpha, opaque if the file has none
+image load_image_rgba(char *filename)
+{
+    return load_image_stb(filename, 4, LAYOUT_CHW);
+}
+
+//
+// Load an image straight into a w x h bilinear resize of it.
+// Samples the 8-bit interleaved stb buffer directly so the full size
+// float image is never allocated. Alpha is dropped like load_image.
+//
+image load_image_resized(char *filename, int w, int h)
+{
+    int sw, sh, c;
+    unsigned char *data = stbi_load(filename, &sw, &sh, &c, 0);
+    if (!data) {
+        fprintf(stderr, "Cannot load image \"%s\"\nSTB Reason: %s\n",
+            filename, stbi_failure_reason());
+        exit(1);
+    }
+    image im = make_image(w, h, (c == 4) ? 3 : c);
+    resize_plan plan = make_resize_plan(sw, sh, w, h, RESIZE_BILINEAR);
+    resize_u8_with_plan(plan, data, c, linear_light ? srgb_decode_table : 0, im);
+    free_resize_plan(plan);
+    free(data);
+    return im;
+}
+
 void free_image(image im)
 {
-    free(im.data);
+    pool_free(im.mem);
+}
+
+// Another handle on im's pixels, free each with free_image. Writes through
+// one show in the other until make_writable gives it its own copy. Views
+// don't own their pixels, so sharing one copies it.
+image share_image(image im)
+{
+    if (!im.mem) return copy_image(im);
+    pool_retain(im.mem);
+    return im;
+}
+
+// Gives *im its own pixels if they are shared. In place operations take
+// images by value and can't swap the buffer themselves, so call this
+// before mutating an image that came from share_image.
+void make_writable(image *im)
+{
+    if (pool_refs(im->mem) <= 1) return;
+    image own = copy_image(*im);
+    free_image(*im);
+    *im = own;
 }
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "image.h"
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+static color_lut make_empty_lut(int size)
+{
+    color_lut lut;
+    lut.size = size;
+    size_t bytes = (size_t)LUT_STRIDE*size*size*size*sizeof(float);
+    lut.data = aligned_alloc(16, bytes);
+    memset(lut.data, 0, bytes);
+    for (int k = 0; k < 3; k++)
+    {
+        lut.domain_min[k] = 0;
+        lut.domain_max[k] = 1;
+    }
+    return lut;
+}
+
+// The lattice color of entry (r, g, b) in a size^3 table
+static void fill_lattice_slice(image slice, int size, int b)
+{
+    float step = 1.0f / (size - 1);
+    for (int g = 0; g < size; g++)
+    {
+        float *rr = image_row(slice, g, 0), *gg = image_row(slice, g, 1), *bb = image_row(slice, g, 2);
+        for (int r = 0; r < size; r++)
+        {
+            rr[r] = r*step;
+            gg[r] = g*step;
+            bb[r] = b*step;
+        }
+    }
+}
+
+color_lut make_color_lut(int size)
+{
+    assert(size >= 2 && size <= LUT_MAX_SIZE);
+    color_lut lut = make_empty_lut(size);
+    float step = 1.0f / (size - 1);
+    for (int i = 0; i < size*size*size; i++)
+    {
+        lut.data[LUT_STRIDE*i+0] = (i % size)*step;
+        lut.data[LUT_STRIDE*i+1] = (i / size % size)*step;
+        lut.data[LUT_STRIDE*i+2] = (i / (size*size))*step;
+    }
+    return lut;
+}
+
+color_lut bake_color_lut(int size, lut_fn fn, void *ctx)
+{
+    assert(size >= 2 && size <= LUT_MAX_SIZE);
+    color_lut lut = make_empty_lut(size);
+
+    // Every blue slice of the lattice is an independent size x size image,
+    // so the (possibly long) chain of operations runs on them in parallel
+    #pragma omp parallel for
+    for (int b = 0; b < size; b++)
+    {
+        image slice = make_image(size, size, 3);
+        fill_lattice_slice(slice, size, b);
+        fn(slice, ctx);
+        for (int g = 0; g < size; g++)
+        {
+            float *out = lut.data + LUT_STRIDE*(b*size + g)*size;
+            for (int r = 0; r < size; r++)
+            {
+                out[LUT_STRIDE*r+0] = image_row(slice, g, 0)[r];
+                out[LUT_STRIDE*r+1] = image_row(slice, g, 1)[r];
+                out[LUT_STRIDE*r+2] = image_row(slice, g, 2)[r];
+            }
+        }
+        free_image(slice);
+    }
+    return lut;
+}
+
+// Pixels per block of the two pass apply loop, rows are split into blocks
+#define LUT_BLOCK 64
+
+// Computes the lattice cell and the tetrahedral walk for a block of
+// pixels. The six orderings are selects on the comparisons rather than
+// branches, and the weights go to one array per corner, so this pass
+// vectorizes.
+static void lut_walk(const float *restrict r, const float *restrict g, const float *restrict b, int n,
+                     const float *lo, const float *scale, int size,
+                     int *restrict base, int *restrict first, int *restrict second, float (*restrict wt)[LUT_BLOCK])
+{
+    // Offsets are carried as floats so the selects stay in one register
+    // type. They are multiples of LUT_STRIDE under 2^26, so exact.
+    float or = LUT_STRIDE, og = LUT_STRIDE*size, ob = LUT_STRIDE*size*size;
+    float top = size - 1, last = size - 2;
+    for (int i = 0; i < n; i++)
+    {
+        float x = fminf(fmaxf((r[i] - lo[0]) * scale[0], 0.0f), top);
+        float y = fminf(fmaxf((g[i] - lo[1]) * scale[1], 0.0f), top);
+        float z = fminf(fmaxf((b[i] - lo[2]) * scale[2], 0.0f), top);
+        float ri = fminf((int)x, last), gi = fminf((int)y, last), bi = fminf((int)z, last);
+        float dr = x - ri, dg = y - gi, db = z - bi;
+
+        // Walk from the cell's origin corner along the largest fraction,
+        // then the middle one, to the far corner
+        float step_max = dr >= dg ? (dr >= db ? or : ob) : (dg >= db ? og : ob);
+        float step_min = dr >= dg ? (dg >= db ? ob : og) : (dr >= db ? ob : or);
+        first[i] = step_max;
+        second[i] = or + og + ob - step_min;
+        base[i] = ri*or + gi*og + bi*ob;
+
+        float wmax = fmaxf(fmaxf(dr, dg), db);
+        float wmin = fminf(fminf(dr, dg), db);
+        float wmid = dr + dg + db - wmax - wmin;
+        wt[0][i] = 1 - wmax;
+        wt[1][i] = wmax - wmid;
+        wt[2][i] = wmid - wmin;
+        wt[3][i] = wmin;
+    }
+}
+
+typedef struct{
+    color_lut lut;
+    float scale[3];
+    int far;
+} lut_apply_ctx;
+
+static void apply_lut_block(float *restrict r, float *restrict g, float *restrict b, int n, void *ctx)
+{
+    const lut_apply_ctx *a = ctx;
+    const float *restrict table = a->lut.data;
+    int base[LUT_BLOCK], first[LUT_BLOCK], second[LUT_BLOCK];
+    float wt[4][LUT_BLOCK];
+    for (int start = 0; start < n; start += LUT_BLOCK, r += LUT_BLOCK, g += LUT_BLOCK, b += LUT_BLOCK)
+    {
+        int count = (start + LUT_BLOCK < n) ? LUT_BLOCK : n - start;
+        lut_walk(r, g, b, count, a->lut.domain_min, a->scale, a->lut.size, base, first, second, wt);
+
+        // Second pass gathers the four corners of each tetrahedron. Each
+        // corner is one aligned 4-float load, blended with the channels
+        // in the lanes. Left to itself the compiler vectorizes across the
+        // corners instead and pays a horizontal sum per channel.
+        for (int i = 0; i < count; i++)
+        {
+            const float *c0 = table + base[i];
+            const float *c1 = c0 + first[i];
+            const float *c2 = c0 + second[i];
+            const float *c3 = c0 + a->far;
+            float w[4] = {wt[0][i], wt[1][i], wt[2][i], wt[3][i]};
+#ifdef __SSE__
+            __m128 o = _mm_mul_ps(_mm_set1_ps(w[0]), _mm_load_ps(c0));
+            o = _mm_add_ps(o, _mm_mul_ps(_mm_set1_ps(w[1]), _mm_load_ps(c1)));
+            o = _mm_add_ps(o, _mm_mul_ps(_mm_set1_ps(w[2]), _mm_load_ps(c2)));
+            o = _mm_add_ps(o, _mm_mul_ps(_mm_set1_ps(w[3]), _mm_load_ps(c3)));
+            r[i] = _mm_cvtss_f32(o);
+            g[i] = _mm_cvtss_f32(_mm_shuffle_ps(o, o, 1));
+            b[i] = _mm_cvtss_f32(_mm_shuffle_ps(o, o, 2));
+#else
+            r[i] = w[0]*c0[0] + w[1]*c1[0] + w[2]*c2[0] + w[3]*c3[0];
+            g[i] = w[0]*c0[1] + w[1]*c1[1] + w[2]*c2[1] + w[3]*c3[1];
+            b[i] = w[0]*c0[2] + w[1]*c1[2] + w[2]*c2[2] + w[3]*c3[2];
+#endif
+        }
+    }
+}
+
+void apply_color_lut(image im, color_lut lut)
+{
+    assert(im.c == 3);
+    assert(lut.size >= 2 && lut.size <= LUT_MAX_SIZE);
+    assert(image_exclusive(im));
+    lut_apply_ctx a;
+    a.lut = lut;
+    a.far = LUT_STRIDE*(1 + lut.size + lut.size*lut.size);
+    for (int k = 0; k < 3; k++) a.scale[k] = (lut.size - 1) / (lut.domain_max[k] - lut.domain_min[k]);
+    for_each_rgb_block(im, apply_lut_block, &a);
+}
+
+//
+// Load a 3D LUT in the Adobe / Resolve .cube format.
+// Red varies fastest in the table, which is also our layout.
+//
+color_lut load_cube_lut(const char *filename)
+{
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        fprintf(stderr, "Cannot load LUT \"%s\"\n", filename);
+        exit(1);
+    }
+
+    color_lut lut = {0};
+    float lo[3] = {0, 0, 0}, hi[3] = {1, 1, 1};
+    int count = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), fp))
+    {
+        char *p = line;
+        while (*p == ' ' || *p == '\t') ++p;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == 0) continue;
+
+        float v[3];
+        int size;
+        if (sscanf(p, "LUT_3D_SIZE %d", &size) == 1) {
+            if (size < 2 || size > LUT_MAX_SIZE || lut.data) break;
+            lut = make_empty_lut(size);
+        } else if (sscanf(p, "DOMAIN_MIN %f %f %f", &lo[0], &lo[1], &lo[2]) == 3) {
+        } else if (sscanf(p, "DOMAIN_MAX %f %f %f", &hi[0], &hi[1], &hi[2]) == 3) {
+        } else if (sscanf(p, "%f %f %f", &v[0], &v[1], &v[2]) == 3) {
+            if (!lut.data || count == lut.size*lut.size*lut.size) break;
+            memcpy(lut.data + LUT_STRIDE*count, v, sizeof(v));
+            ++count;
+        }
+        // TITLE and unknown keywords are ignored
+    }
+    fclose(fp);
+
+    if (!lut.data || count != lut.size*lut.size*lut.size) {
+        fprintf(stderr, "Cannot load LUT \"%s\"\nReason: expected a LUT_3D_SIZE and its table\n", filename);
+        exit(1);
+    }
+    memcpy(lut.domain_min, lo, sizeof(lo));
+    memcpy(lut.domain_max, hi, sizeof(hi));
+    return lut;
+}
+
+void free_color_lut(color_lut lut)
+{
+    free(lut.data);
+}
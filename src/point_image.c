@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+#include "image.h"
+
+// Pixels per block: every op of the chain runs over a block while it is
+// still in L1, so a plane is read and written once however long the chain.
+// Blocks never cross a row since rows can be padded.
+#define POINT_BLOCK 1024
+
+point_ops make_point_ops()
+{
+    point_ops p;
+    p.n = 0;
+    p.cap = 0;
+    p.ops = 0;
+    return p;
+}
+
+static void add_point_op(point_ops *p, int type, int c, float a, float b)
+{
+    // Back to back affine ops on the same channels fold into one
+    if (type == POINT_AFFINE && p->n > 0)
+    {
+        point_op *last = &p->ops[p->n - 1];
+        if (last->type == POINT_AFFINE && last->c == c)
+        {
+            last->b = last->b*a + b;
+            last->a *= a;
+            return;
+        }
+    }
+    if (p->n == p->cap)
+    {
+        p->cap = p->cap ? 2*p->cap : 8;
+        p->ops = realloc(p->ops, p->cap*sizeof(point_op));
+    }
+    point_op op = {type, c, a, b};
+    p->ops[p->n++] = op;
+}
+
+void add_point_affine(point_ops *p, int c, float scale, float shift)
+{
+    add_point_op(p, POINT_AFFINE, c, scale, shift);
+}
+
+void add_point_clamp(point_ops *p, int c, float lo, float hi)
+{
+    add_point_op(p, POINT_CLAMP, c, lo, hi);
+}
+
+void add_point_gamma(point_ops *p, int c, float gamma)
+{
+    add_point_op(p, POINT_GAMMA, c, gamma, 0);
+}
+
+void add_point_threshold(point_ops *p, int c, float thresh)
+{
+    add_point_op(p, POINT_THRESHOLD, c, thresh, 0);
+}
+
+static void run_point_op(point_op op, float *restrict x, int n)
+{
+    float a = op.a, b = op.b;
+    switch (op.type)
+    {
+        case POINT_AFFINE:
+            for (int i = 0; i < n; i++) x[i] = x[i]*a + b;
+            break;
+        case POINT_CLAMP:
+            for (int i = 0; i < n; i++) x[i] = fminf(fmaxf(x[i], a), b);
+            break;
+        case POINT_GAMMA:
+            for (int i = 0; i < n; i++) x[i] = (x[i] > 0) ? powf(x[i], a) : 0;
+            break;
+        case POINT_THRESHOLD:
+            for (int i = 0; i < n; i++) x[i] = (x[i] > a) ? 1.0f : 0.0f;
+            break;
+    }
+}
+
+static int point_op_applies(point_op op, int c)
+{
+    return op.c < 0 || op.c == c;
+}
+
+void apply_point_ops(image im, point_ops p)
+{
+    assert(image_exclusive(im));
+    // A chain that treats every channel alike walks interleaved rows whole
+    int all = 1;
+    for (int k = 0; k < p.n; k++) all &= p.ops[k].c < 0;
+    if (all) im = flatten_channels(im);
+
+    for (int c = 0; c < im.c; c++)
+    {
+        int any = 0;
+        for (int k = 0; k < p.n; k++) any |= point_op_applies(p.ops[k], c);
+        if (!any) continue;
+
+        #pragma omp parallel for
+        for (int y = 0; y < im.h; y++)
+        {
+            float *row = image_row(im, y, c);
+            float tmp[POINT_BLOCK];
+            // Strided and compact pixels are gathered into a block and put back
+            int direct = im.step == 1 && im.type == IMAGE_F32;
+            for (int start = 0; start < im.w; start += POINT_BLOCK)
+            {
+                int len = (start + POINT_BLOCK < im.w) ? POINT_BLOCK : im.w - start;
+                float *x = direct ? row + start : tmp;
+                if (!direct) widen_pixels(im.type, image_ptr(im, start, y, c), im.step, tmp, len);
+                for (int k = 0; k < p.n; k++)
+                {
+                    if (point_op_applies(p.ops[k], c)) run_point_op(p.ops[k], x, len);
+                }
+                if (!direct) narrow_pixels(im.type, image_ptr(im, start, y, c), im.step, tmp, len);
+            }
+        }
+    }
+}
+
+void free_point_ops(point_ops p)
+{
+    free(p.ops);
+}
+
+void scale_image(image im, int c, float v)
+{
+    assert(image_exclusive(im));
+    if (c < 0 || c >= im.c) return;
+    point_op op = {POINT_AFFINE, c, v, 0};
+    point_ops p = {1, 1, &op};
+    apply_point_ops(im, p);
+}
+
+void threshold_image(image im, float thresh)
+{
+    point_op op = {POINT_THRESHOLD, -1, thresh, 0};
+    point_ops p = {1, 1, &op};
+    apply_point_ops(im, p);
+}
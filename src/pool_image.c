@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "image.h"
+
+// Freed image buffers are kept on per size class free lists and handed
+// back out by make_image, so pipelines that allocate the same intermediate
+// sizes over and over stop paying for page faults on fresh memory.
+// Classes are four per power of two, so a block wastes at most 25%.
+#define POOL_ALIGN 64
+#define POOL_MIN 256
+#define POOL_CLASSES 256
+// Bytes the pool keeps cached before freed blocks go back to the system
+#define IMAGE_POOL_LIMIT ((size_t)256 << 20)
+
+// Lives in the POOL_ALIGN bytes in front of every block so the pixels
+// stay aligned. refs counts the images sharing a block in use.
+typedef struct pool_block{
+    struct pool_block *next;
+    size_t size;
+    int cls;
+    atomic_int refs;
+} pool_block;
+
+static pool_block *free_blocks[POOL_CLASSES];
+static size_t pool_cached = 0;
+static size_t pool_limit = IMAGE_POOL_LIMIT;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Rounds size up to its class, returns the class index
+static int pool_class(size_t size, size_t *rounded)
+{
+    if (size < POOL_MIN) size = POOL_MIN;
+    int e = 63 - __builtin_clzll(size - 1);
+    size_t step = (size_t)1 << (e - 2);
+    size_t r = (size + step - 1) & ~(step - 1);
+    *rounded = r;
+    return 4*e + (int)(r / step) - 5;
+}
+
+void *pool_alloc(size_t size)
+{
+    size_t rounded;
+    int cls = pool_class(size, &rounded);
+
+    pthread_mutex_lock(&pool_lock);
+    pool_block *b = free_blocks[cls];
+    if (b)
+    {
+        free_blocks[cls] = b->next;
+        pool_cached -= b->size;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    if (!b)
+    {
+        void *mem = 0;
+        if (posix_memalign(&mem, POOL_ALIGN, POOL_ALIGN + rounded)) return 0;
+        b = mem;
+        b->size = rounded;
+        b->cls = cls;
+    }
+    atomic_init(&b->refs, 1);
+    return (char *)b + POOL_ALIGN;
+}
+
+static inline pool_block *pool_header(void *p)
+{
+    return (pool_block *)((char *)p - POOL_ALIGN);
+}
+
+void pool_retain(void *p)
+{
+    if (p) atomic_fetch_add_explicit(&pool_header(p)->refs, 1, memory_order_relaxed);
+}
+
+int pool_refs(void *p)
+{
+    return p ? atomic_load_explicit(&pool_header(p)->refs, memory_order_acquire) : 0;
+}
+
+// Drops one reference, the block goes back to the pool with the last one
+void pool_free(void *p)
+{
+    if (!p) return;
+    pool_block *b = pool_header(p);
+    // Release our writes to the block, and see everyone else's before reuse
+    if (atomic_fetch_sub_explicit(&b->refs, 1, memory_order_acq_rel) != 1) return;
+
+    pthread_mutex_lock(&pool_lock);
+    int keep = pool_cached + b->size <= pool_limit;
+    if (keep)
+    {
+        b->next = free_blocks[b->cls];
+        free_blocks[b->cls] = b;
+        pool_cached += b->size;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    if (!keep) free(b);
+}
+
+// Frees cached blocks, largest classes first, until at most limit bytes
+// remain cached. Must be called with pool_lock held.
+static void trim_pool(size_t limit)
+{
+    for (int cls = POOL_CLASSES - 1; cls >= 0 && pool_cached > limit; cls--)
+    {
+        while (free_blocks[cls] && pool_cached > limit)
+        {
+            pool_block *b = free_blocks[cls];
+            free_blocks[cls] = b->next;
+            pool_cached -= b->size;
+            free(b);
+        }
+    }
+}
+
+void set_image_pool_limit(size_t bytes)
+{
+    pthread_mutex_lock(&pool_lock);
+    pool_limit = bytes;
+    trim_pool(bytes);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+void clear_image_pool()
+{
+    pthread_mutex_lock(&pool_lock);
+    trim_pool(0);
+    pthread_mutex_unlock(&pool_lock);
+}
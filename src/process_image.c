@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <math.h>
@@ -16,11 +17,18 @@ float get_pixel(image im, int x, int y, int c)
     {
         return 0;
     }    
-    else
+    else if(im.type == IMAGE_F32)
     {
-    float *value= im.data + (c * im.w * im.h)+(y * im.w)+ x;
+    float *value= image_row(im, y, c) + x*im.step;
     return *value;
     }
+    else
+    {
+    //compact storage types are widened on the way out
+    float v;
+    widen_pixels(im.type, image_ptr(im, x, y, c), 1, &v, 1);
+    return v;
+    }
 }
 
 void set_pixel(image im, int x, int y, int c, float v)
@@ -32,43 +40,205 @@ void set_pixel(image im, int x, int y, int c, float v)
     {
         ;
     }
-    else
+    else if(im.type == IMAGE_F32)
     {
     //setting value
-    im.data[(c * im.w * im.h)+(y * im.w)+ x]=v;
+    image_row(im, y, c)[x*im.step]=v;
+    }
+    else
+    {
+    narrow_pixels(im.type, image_ptr(im, x, y, c), 1, &v, 1);
+    }
+}
+
+// Pixels converted at a time when copying or graying compact types
+#define PIXEL_BLOCK 256
+
+// Copies the pixels of src into dst of the same shape, whatever their
+// layouts and types. Rows are copied one by one since the strides can differ.
+static void copy_pixels(image src, image dst)
+{
+    if(src.type != IMAGE_F32 || dst.type != IMAGE_F32)
+    {
+       float tmp[PIXEL_BLOCK];
+       for(int c=0;c<src.c;c++)
+       {
+          for(int y=0;y<src.h;y++)
+          {
+             for(int x=0;x<src.w;x+=PIXEL_BLOCK)
+             {
+                int n = (x + PIXEL_BLOCK < src.w) ? PIXEL_BLOCK : src.w - x;
+                widen_pixels(src.type, image_ptr(src, x, y, c), src.step, tmp, n);
+                narrow_pixels(dst.type, image_ptr(dst, x, y, c), dst.step, tmp, n);
+             }
+          }
+       }
+       return;
+    }
+    image a = flatten_channels(src), b = flatten_channels(dst);
+    if(a.w != b.w)
+    {
+       a = src;
+       b = dst;
+    }
+    for(int c=0;c<a.c;c++)
+    {
+       for(int y=0;y<a.h;y++)
+       {
+          const float *s = image_row(a, y, c);
+          float *d = image_row(b, y, c);
+          if(a.step == 1 && b.step == 1) memcpy(d, s, a.w*sizeof(float));
+          else for(int x=0;x<a.w;x++) d[x*b.step] = s[x*a.step];
+       }
     }
 }
 
 image copy_image(image im)
 {
-    image copy = make_image(im.w, im.h, im.c);
+    image copy = make_image_uninit_typed(im.w, im.h, im.c, im.layout, im.type);
     //okay, so we just need to fill the data attribute 
-    //we can loop by array 
-    
-    for(int i=0;i<((im.c)*(im.w)*(im.h));i++)
+    // An image owning its buffer has the same padded shape as the copy, so
+    // the whole block goes over in one memcpy
+    if(im.mem && copy.data && im.stride == copy.stride && im.plane == copy.plane && im.step == copy.step)
     {
-       copy.data[i]=im.data[i];       
+       memcpy(copy.data, im.data, image_bytes(im));
+       return copy;
     }
-        
+    copy_pixels(im, copy);
     return copy;
 }
 
+// Copies im into out of the same size, converting layout and type as needed
+void copy_image_into(image im, image out)
+{
+    assert(im.w == out.w && im.h == out.h && im.c == out.c);
+    if(im.data == out.data && im.layout == out.layout && im.type == out.type) return;
+    copy_pixels(im, out);
+}
+
+// Planar copy of im, for the algorithms that work on whole planes
+image to_planar(image im)
+{
+    image out = make_image_uninit(im.w, im.h, im.c);
+    copy_pixels(im, out);
+    return out;
+}
+
+image to_interleaved(image im)
+{
+    image out = make_image_uninit_layout(im.w, im.h, im.c, LAYOUT_HWC);
+    copy_pixels(im, out);
+    return out;
+}
+
+// A w x h window of im starting at (x, y). The view shares im's pixels,
+// so writes through it land in im; it must not outlive im.
+image view_image(image im, int x, int y, int w, int h)
+{
+    assert(x >= 0 && y >= 0 && w >= 0 && h >= 0 && x + w <= im.w && y + h <= im.h);
+    image view = im;
+    view.w = w;
+    view.h = h;
+    view.data = image_ptr(im, x, y, 0);
+    view.mem = 0;
+    return view;
+}
+
+// Channels c .. c+n-1 of im, sharing its pixels like view_image
+image view_channels(image im, int c, int n)
+{
+    assert(c >= 0 && n >= 0 && c + n <= im.c);
+    image view = im;
+    view.c = n;
+    view.data = image_ptr(im, 0, 0, c);
+    view.mem = 0;
+    return view;
+}
+
+static void gray_row(const float *restrict r, const float *restrict g, const float *restrict b, float *restrict y, int n)
+{
+    for(int i=0;i<n;i++)
+    {
+       y[i] = 0.299f*r[i] + 0.587f*g[i] + 0.114f*b[i];
+    }
+}
+
+// Same for a row of pixels step floats apart with channels plane apart
+static inline void gray_row_strided(const float *restrict p, int step, size_t plane, float *restrict y, int n)
+{
+    for(int i=0;i<n;i++)
+    {
+       const float *q = p + i*step;
+       y[i] = 0.299f*q[0] + 0.587f*q[plane] + 0.114f*q[2*plane];
+    }
+}
+
 image rgb_to_grayscale(image im)
+{
+    image gray = make_image_uninit(im.w, im.h, 1);
+    rgb_to_grayscale_into(im, gray);
+    return gray;
+}
+
+void rgb_to_grayscale_into(image im, image gray)
 {
     assert(im.c == 3);
-    image gray = make_image(im.w, im.h, 1);
+    assert(gray.w == im.w && gray.h == im.h && gray.c == 1);
     
-     for(int i=0;i<((im.w)*(im.h));i++)
+    // Straight loop over the three planes in float so it vectorizes
+    // (and contracts to FMAs when built with NATIVE=1)
+    if(im.type != IMAGE_F32 || gray.type != IMAGE_F32 || gray.step != 1)
     {
-       float luma_value= (0.299*im.data[i]) +  (0.587*im.data[i+((im.w)*(im.h))]) + (0.114*im.data[i+2*((im.w)*(im.h))]);
-       gray.data[i]=luma_value;       
+       // Compact types and strided outputs go through a block at a time
+       float rgb[3][PIXEL_BLOCK], y[PIXEL_BLOCK];
+       for(int j=0;j<im.h;j++)
+       {
+          for(int x=0;x<im.w;x+=PIXEL_BLOCK)
+          {
+             int n = (x + PIXEL_BLOCK < im.w) ? PIXEL_BLOCK : im.w - x;
+             for(int k=0;k<3;k++) widen_pixels(im.type, image_ptr(im, x, j, k), im.step, rgb[k], n);
+             gray_row(rgb[0], rgb[1], rgb[2], y, n);
+             narrow_pixels(gray.type, image_ptr(gray, x, j, 0), gray.step, y, n);
+          }
+       }
+       return;
+    }
+    for(int j=0;j<im.h;j++)
+    {
+       float *y = image_row(gray, j, 0);
+       if(im.step == 1) gray_row(image_row(im, j, 0), image_row(im, j, 1), image_row(im, j, 2), y, im.w);
+       // Packed RGB gets the constant strides inlined
+       else if(im.step == 3 && im.plane == 1) gray_row_strided(image_row(im, j, 0), 3, 1, y, im.w);
+       else gray_row_strided(image_row(im, j, 0), im.step, im.plane, y, im.w);
     }
-    
-    return gray;
+}
+
+// Luma weights scaled by 2^14, they sum to exactly 1<<14
+#define LUMA_R 4899
+#define LUMA_G 9617
+#define LUMA_B 1868
+
+static inline void gray_u8_strided(const unsigned char *restrict src, int c, unsigned char *restrict gray, int n)
+{
+    for(int i=0;i<n;i++)
+    {
+       const unsigned char *p = src + i*c;
+       gray[i] = (LUMA_R*p[0] + LUMA_G*p[1] + LUMA_B*p[2] + (1 << 13)) >> 14;
+    }
+}
+
+void rgb_to_grayscale_u8(const unsigned char *src, int c, unsigned char *gray, int n)
+{
+    assert(c >= 3);
+    // Packed RGB and RGBA get the constant strides inlined
+    if(c == 3) gray_u8_strided(src, 3, gray, n);
+    else if(c == 4) gray_u8_strided(src, 4, gray, n);
+    else gray_u8_strided(src, c, gray, n);
 }
 
 void shift_image(image im, int c, float v)
 {
+    assert(image_exclusive(im));
     // Okay add v to every pixel in channel c , got it 
     // we can check the validity 
     if(c<0 || c>=im.c)
@@ -77,34 +247,21 @@ void shift_image(image im, int c, float v)
     }
     else
     {
-    //Assuming CHW arrangement
-    for(int i=0;i<((im.w)*(im.h));i++)
-    {
-        im.data[i+(c*((im.w)*(im.h)))]+=v;
-    }
+    //A one op point pipeline, which knows about strides and layouts
+    point_op op = {POINT_AFFINE, c, 1, v};
+    point_ops p = {1, 1, &op};
+    apply_point_ops(im, p);
     }
 }
 
 void clamp_image(image im)
 {
+    assert(image_exclusive(im));
     //all we have to do is restrict the pixel data values between 0 and 1 , roger that 
     
-    for(int i=0;i<((im.c)*(im.w)*(im.h));i++)
-    {
-       if(im.data[i] <= 0.0f)
-       {
-           im.data[i]=0.0f;
-       }
-       else if(im.data[i] >= 1.0f)
-       {
-           im.data[i]=1.0f;
-       } 
-       else
-       {
-           ;
-       }    
-        
-    }
+    point_op op = {POINT_CLAMP, -1, 0, 1};
+    point_ops p = {1, 1, &op};
+    apply_point_ops(im, p);
     
 }
 
@@ -120,124 +277,73 @@ float three_way_min(float a, float b, float c)
     return (a < b) ? ( (a < c) ? a : c) : ( (b < c) ? b : c) ;
 }
 
-void rgb_to_hsv(image im)
+// Branch free: every candidate hue is computed and the right one is
+// picked with selects, so the loop vectorizes instead of mispredicting
+// on natural images. Ties pick red, then green, then blue like before.
+static void rgb_to_hsv_planes(float *restrict r, float *restrict g, float *restrict b, int n, void *ctx)
 {
-    //Cool , this is interesting 
-    
-    for(int i=0;i<((im.w)*(im.h));i++)
-    {
-        // First we need to extract the rgb components 
-        float red= im.data[i];
-        float green= im.data[i+((im.w)*(im.h))];
-        float blue= im.data[i+2*((im.w)*(im.h))];
-                            
-        // Finding the value should be easy 
-        float Value=three_way_max(red,green,blue);
+    for(int i=0;i<n;i++)
+    {
+        float red = r[i], green = g[i], blue = b[i];
         
-        //Saturation
-        float min=three_way_min(red,green,blue);
-        float C=Value-min;
-        float Saturation;
-        if((red==0.0f && green==0.0f )&& blue==0.0f)
-        {
-            Saturation=0.0f;
-        }                   
-        else
-        {
-            Saturation= C/Value;
-        }
-                                                
-        //HUE
-        float Hue,Hue_dash;
-        if (C == 0)
-        {
-            Hue = 0;
-        }
-        else if (Value == red)
-        {
-          Hue_dash = (green - blue) / C;
-        }
-        else if (Value == green)
-        {
-           Hue_dash = ((blue - red) / C) + 2;
-        }       
-        else if (Value == blue)
-        {
-          Hue_dash = ((red - green) / C) + 4;
-        }
-        else
-        {
-           ;
-        } 
+        float Value = fmaxf(fmaxf(red, green), blue);
+        float min = fminf(fminf(red, green), blue);
+        float C = Value - min;
         
-        //We got Hue_Dash
-        if(C!=0)  
-        {
-        if(Hue_dash<0)
-        {
-            Hue= (Hue_dash/6) + 1 ;
-        }
-        else
-        {
-            Hue= (Hue_dash/6) ;
-        }
-        }                                                            
+        // Divisors are made safe first so the divides run unconditionally
+        int black = (red==0.0f) & (green==0.0f) & (blue==0.0f);
+        float Saturation = C / (black ? 1.0f : Value);
         
-        //setting the values
-        im.data[i]=Hue;
-        im.data[i+((im.w)*(im.h))]=Saturation;
-        im.data[i+2*((im.w)*(im.h))]=Value;                    
-                            
-                            
+        float inv_C = 1.0f / ((C != 0) ? C : 1.0f);
+        float hue_red = (green - blue) * inv_C;
+        float hue_green = (blue - red) * inv_C + 2;
+        float hue_blue = (red - green) * inv_C + 4;
+        float Hue_dash = hue_blue;
+        Hue_dash = (Value == green) ? hue_green : Hue_dash;
+        Hue_dash = (Value == red) ? hue_red : Hue_dash;
+        float Hue = Hue_dash/6 + ((Hue_dash < 0) ? 1.0f : 0.0f);
+        Hue = (C != 0) ? Hue : 0.0f;
+        
+        r[i] = Hue;
+        g[i] = Saturation;
+        b[i] = Value;
     }
 }
 
-void hsv_to_rgb(image im)
+void rgb_to_hsv(image im)
 {
-    for (int h = 0; h < im.h; h++) 
-    {
-        for (int w = 0; w < im.w; w++) 
-        {
-            float h_val = get_pixel(im, w, h, 0);
-            float s_val = get_pixel(im, w, h, 1);
-            float v_val = get_pixel(im, w, h, 2);
-
-            float c = s_val * v_val;
-            float x = c * (1 - fabsf(fmodf(h_val / 60, 2) - 1));
-            float m = v_val - c;
-
-            float r, g, b;
-            if (h_val < 60) {
-                r = c;
-                g = x;
-                b = 0;
-            } else if (h_val < 120) {
-                r = x;
-                g = c;
-                b = 0;
-            } else if (h_val < 180) {
-                r = 0;
-                g = c;
-                b = x;
-            } else if (h_val < 240) {
-                r = 0;
-                g = x;
-                b = c;
-            } else if (h_val < 300) {
-                r = x;
-                g = 0;
-                b = c;
-            } else {
-                r = c;
-                g = 0;
-                b = x;
-            }
-
-            set_pixel(im, w, h, 0, r + m);
-            set_pixel(im, w, h, 1, g + m);
-            set_pixel(im, w, h, 2, b + m);
-        }
-    }
+    assert(image_exclusive(im));
+    for_each_rgb_block(im, rgb_to_hsv_planes, 0);
+}
 
+// Component n of the hue hexagon (5 red, 3 green, 1 blue). The sector
+// falls out of the arithmetic, so there is no six way branch.
+static inline float hsv_component(float n, float h6, float v, float c)
+{
+    float k = n + h6;
+    // k mod 6 with truncation, which vectorizes without SSE4.1 floor
+    k = k - 6*(float)(int)(k * (1.0f/6));
+    k = (k < 0) ? k + 6 : k;
+    float t = fminf(fminf(k, 4 - k), 1.0f);
+    return v - c*fmaxf(t, 0.0f);
+}
 
+static void hsv_to_rgb_planes(float *restrict r, float *restrict g, float *restrict b, int n, void *ctx)
+{
+    for(int i=0;i<n;i++)
+    {
+        float h6 = r[i] * 6;
+        float v = b[i];
+        float c = g[i] * v;
+        r[i] = hsv_component(5, h6, v, c);
+        g[i] = hsv_component(3, h6, v, c);
+        b[i] = hsv_component(1, h6, v, c);
+    }
+}
+
+void hsv_to_rgb(image im)
+{
+    assert(image_exclusive(im));
+    // Hue is in [0,1) like rgb_to_hsv produces, wrapping around outside it
+    for_each_rgb_block(im, hsv_to_rgb_planes, 0);
 }
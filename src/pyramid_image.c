@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "image.h"
+
+// 5-tap binomial reduce kernel, [1 4 6 4 1] / 16 in each direction
+static const float binomial5[5] = {1/16., 4/16., 6/16., 4/16., 1/16.};
+
+static int clamp_index(int i, int n)
+{
+    return (i < 0) ? 0 : ((i >= n) ? n - 1 : i);
+}
+
+// Produces row y of a reduced level from the rows of its parent.
+// The parent rows needed are 2y-2 .. 2y+2 (clamped at the borders),
+// tmp must hold at least parent.w floats.
+static void reduce_row(const float *parent, int pw, int ph, float *out, int w, int y, float *tmp)
+{
+    const float *r0 = parent + clamp_index(2*y - 2, ph)*(size_t)pw;
+    const float *r1 = parent + clamp_index(2*y - 1, ph)*(size_t)pw;
+    const float *r2 = parent + clamp_index(2*y    , ph)*(size_t)pw;
+    const float *r3 = parent + clamp_index(2*y + 1, ph)*(size_t)pw;
+    const float *r4 = parent + clamp_index(2*y + 2, ph)*(size_t)pw;
+
+    // Vertical pass over the full parent row
+    for (int x = 0; x < pw; x++)
+    {
+        tmp[x] = binomial5[0]*r0[x] + binomial5[1]*r1[x] + binomial5[2]*r2[x]
+               + binomial5[3]*r3[x] + binomial5[4]*r4[x];
+    }
+
+    // Horizontal pass, decimating by 2
+    for (int x = 0; x < w; x++)
+    {
+        float sum = 0;
+        for (int k = 0; k < 5; k++)
+        {
+            sum += binomial5[k] * tmp[clamp_index(2*x + k - 2, pw)];
+        }
+        out[x] = sum;
+    }
+}
+
+image_pyramid make_image_pyramid(image im, int levels)
+{
+    assert(im.layout == LAYOUT_CHW && im.type == IMAGE_F32);
+    image_pyramid p;
+
+    // Count the levels first so everything fits in one allocation
+    int max_levels = 1;
+    for (int w = im.w, h = im.h; w > 1 || h > 1; w = (w + 1)/2, h = (h + 1)/2)
+    {
+        max_levels++;
+    }
+    if (levels <= 0 || levels > max_levels) levels = max_levels;
+
+    p.n = levels;
+    p.levels = calloc(levels, sizeof(image));
+
+    size_t total = 0;
+    for (int l = 0, w = im.w, h = im.h; l < levels; l++, w = (w + 1)/2, h = (h + 1)/2)
+    {
+        // Levels are packed with stride == w so they stay contiguous
+        p.levels[l] = make_empty_image(w, h, im.c);
+        total += (size_t)w*h*im.c;
+    }
+    p.data = calloc(total, sizeof(float));
+
+    float *next = p.data;
+    for (int l = 0; l < levels; l++)
+    {
+        p.levels[l].data = next;
+        next += (size_t)p.levels[l].w*p.levels[l].h*im.c;
+    }
+
+    // Single sweep down the source: as soon as a row of level l is written,
+    // every row of level l+1 that only depends on rows already produced is
+    // reduced while its five parent rows are still hot in cache.
+    int *done = calloc(levels, sizeof(int));
+    float *tmp = calloc(im.w, sizeof(float));
+
+    for (int c = 0; c < im.c; c++)
+    {
+        memset(done, 0, levels*sizeof(int));
+        for (int y = 0; y < im.h; y++)
+        {
+            memcpy(image_row(p.levels[0], y, c), image_row(im, y, c), im.w*sizeof(float));
+            done[0] = y + 1;
+
+            for (int l = 0; l + 1 < levels; l++)
+            {
+                image a = p.levels[l];
+                image b = p.levels[l+1];
+                float *parent = a.data + (size_t)c*a.w*a.h;
+                float *child = b.data + (size_t)c*b.w*b.h;
+                while (done[l+1] < b.h && clamp_index(2*done[l+1] + 2, a.h) < done[l])
+                {
+                    reduce_row(parent, a.w, a.h, child + (size_t)done[l+1]*b.w, b.w, done[l+1], tmp);
+                    done[l+1]++;
+                }
+            }
+        }
+        for (int l = 0; l < levels; l++) assert(done[l] == p.levels[l].h);
+    }
+
+    free(done);
+    free(tmp);
+    return p;
+}
+
+void free_image_pyramid(image_pyramid p)
+{
+    free(p.data);
+    free(p.levels);
+}
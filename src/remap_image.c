@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+#include "image.h"
+
+#define REMAP_SCALE (1 << REMAP_BITS)
+
+// Bilinear weights for every (fx, fy) subpixel pair of the fixed point map
+static float remap_weights[REMAP_SCALE*REMAP_SCALE][4];
+static int remap_weights_ready = 0;
+
+static void init_remap_weights()
+{
+    if (remap_weights_ready) return;
+    for (int fy = 0; fy < REMAP_SCALE; fy++)
+    {
+        for (int fx = 0; fx < REMAP_SCALE; fx++)
+        {
+            float dx = (float)fx / REMAP_SCALE;
+            float dy = (float)fy / REMAP_SCALE;
+            float *w = remap_weights[fy*REMAP_SCALE + fx];
+            w[0] = (1 - dx) * (1 - dy);
+            w[1] = dx * (1 - dy);
+            w[2] = (1 - dx) * dy;
+            w[3] = dx * dy;
+        }
+    }
+    remap_weights_ready = 1;
+}
+
+static remap_map make_empty_remap(int w, int h, int type)
+{
+    remap_map map;
+    map.w = w;
+    map.h = h;
+    map.type = type;
+    map.x = map.y = 0;
+    map.xy = 0;
+    map.frac = 0;
+    if (type == REMAP_FIXED)
+    {
+        assert(w < 32768 && h < 32768);
+        map.xy = calloc((size_t)2*w*h, sizeof(short));
+        map.frac = calloc((size_t)w*h, sizeof(unsigned short));
+        init_remap_weights();
+    }
+    else
+    {
+        map.x = calloc((size_t)w*h, sizeof(float));
+        map.y = calloc((size_t)w*h, sizeof(float));
+    }
+    return map;
+}
+
+static short clamp_short(float v)
+{
+    return v < -32768 ? -32768 : (v > 32767 ? 32767 : (short)v);
+}
+
+static void set_remap(remap_map map, size_t i, float sx, float sy)
+{
+    if (map.type == REMAP_FIXED)
+    {
+        int fx = (int)lrintf(sx * REMAP_SCALE);
+        int fy = (int)lrintf(sy * REMAP_SCALE);
+        // Arithmetic shift floors negative coordinates as well
+        map.xy[2*i]   = clamp_short(fx >> REMAP_BITS);
+        map.xy[2*i+1] = clamp_short(fy >> REMAP_BITS);
+        map.frac[i] = ((fy & (REMAP_SCALE - 1)) << REMAP_BITS) | (fx & (REMAP_SCALE - 1));
+    }
+    else
+    {
+        map.x[i] = sx;
+        map.y[i] = sy;
+    }
+}
+
+remap_map make_remap(int w, int h, remap_fn fn, void *ctx, int type)
+{
+    remap_map map = make_empty_remap(w, h, type);
+    #pragma omp parallel for
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            float sx, sy;
+            fn(x, y, &sx, &sy, ctx);
+            set_remap(map, (size_t)y*w + x, sx, sy);
+        }
+    }
+    return map;
+}
+
+remap_map make_undistort_remap(int w, int h, float k1, float k2, int type)
+{
+    remap_map map = make_empty_remap(w, h, type);
+    float cx = (w - 1) / 2.f;
+    float cy = (h - 1) / 2.f;
+    // Radii are measured in units of the half diagonal
+    float norm = 1 / sqrtf(cx*cx + cy*cy);
+    #pragma omp parallel for
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            float nx = (x - cx) * norm;
+            float ny = (y - cy) * norm;
+            float r2 = nx*nx + ny*ny;
+            float k = 1 + k1*r2 + k2*r2*r2;
+            set_remap(map, (size_t)y*w + x, cx + (x - cx)*k, cy + (y - cy)*k);
+        }
+    }
+    return map;
+}
+
+// Zero padded tap, same as get_pixel outside the image
+static inline float remap_tap(const float *plane, size_t s, int w, int h, int x, int y)
+{
+    return (x < 0 || x >= w || y < 0 || y >= h) ? 0 : plane[y*s + x];
+}
+
+// s is the row stride of plane
+static inline float remap_sample(const float *plane, size_t s, int w, int h, int x1, int y1, const float *wt)
+{
+    if (x1 >= 0 && x1 < w - 1 && y1 >= 0 && y1 < h - 1)
+    {
+        const float *p = plane + y1*s + x1;
+        return wt[0]*p[0] + wt[1]*p[1] + wt[2]*p[s] + wt[3]*p[s+1];
+    }
+    return wt[0]*remap_tap(plane, s, w, h, x1, y1)   + wt[1]*remap_tap(plane, s, w, h, x1+1, y1)
+         + wt[2]*remap_tap(plane, s, w, h, x1, y1+1) + wt[3]*remap_tap(plane, s, w, h, x1+1, y1+1);
+}
+
+void remap_image(image src, image dst, remap_map map)
+{
+    assert(dst.w == map.w && dst.h == map.h && dst.c == src.c);
+    assert(src.layout == LAYOUT_CHW && dst.layout == LAYOUT_CHW);
+    assert(src.type == IMAGE_F32 && dst.type == IMAGE_F32);
+
+    #pragma omp parallel for
+    for (int y = 0; y < map.h; y++)
+    {
+        // The map row stays in L1 while every channel is resampled
+        for (int c = 0; c < src.c; c++)
+        {
+            const float *plane = image_row(src, 0, c);
+            float *row = image_row(dst, y, c);
+            if (map.type == REMAP_FIXED)
+            {
+                const short *xy = map.xy + (size_t)2*y*map.w;
+                const unsigned short *frac = map.frac + (size_t)y*map.w;
+                for (int x = 0; x < map.w; x++)
+                {
+                    row[x] = remap_sample(plane, src.stride, src.w, src.h, xy[2*x], xy[2*x+1], remap_weights[frac[x]]);
+                }
+            }
+            else
+            {
+                const float *mx = map.x + (size_t)y*map.w;
+                const float *my = map.y + (size_t)y*map.w;
+                for (int x = 0; x < map.w; x++)
+                {
+                    int x1 = (int)floorf(mx[x]);
+                    int y1 = (int)floorf(my[x]);
+                    float dx = mx[x] - x1;
+                    float dy = my[x] - y1;
+                    float wt[4] = {(1 - dx) * (1 - dy), dx * (1 - dy), (1 - dx) * dy, dx * dy};
+                    row[x] = remap_sample(plane, src.stride, src.w, src.h, x1, y1, wt);
+                }
+            }
+        }
+    }
+}
+
+void free_remap(remap_map map)
+{
+    free(map.x);
+    free(map.y);
+    free(map.xy);
+    free(map.frac);
+}
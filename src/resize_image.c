@@ -1,6 +1,30 @@
+#include <stdlib.h>
 #include <math.h>
+#include <assert.h>
 #include "image.h"
 
+// The last plan each thread resized with. Loops over same sized frames
+// build it once and then resize without allocating. A plan for other
+// sizes replaces it; free_resize_cache drops it.
+static _Thread_local resize_plan cached_plan;
+
+void free_resize_cache()
+{
+    if (cached_plan.rows) free_resize_plan(cached_plan);
+    cached_plan.rows = 0;
+}
+
+static resize_plan cached_resize_plan(int src_w, int src_h, int dst_w, int dst_h, int method)
+{
+    resize_plan *p = &cached_plan;
+    if (!p->rows || p->src_w != src_w || p->src_h != src_h ||
+        p->dst_w != dst_w || p->dst_h != dst_h || p->method != method)
+    {
+        if (p->rows) free_resize_plan(*p);
+        *p = make_resize_plan(src_w, src_h, dst_w, dst_h, method);
+    }
+    return *p;
+}
 
 float nn_interpolate(image im, float x, float y, int c)
 {
@@ -12,27 +36,16 @@ float nn_interpolate(image im, float x, float y, int c)
 
 image nn_resize(image im, int w, int h)
 {
-    image new_image = make_image(w, h, im.c);
-
-    float width_scale = (float)im.w / w;
-    float height_scale = (float)im.h / h;
-
-    for (int k = 0; k < im.c; k++) 
-    {
-        for (int j = 0; j < h; j++) 
-        {
-            for (int i = 0; i < w; i++) 
-            {
-                float x = (i + 0.5) * width_scale - 0.5;
-                float y = (j + 0.5) * height_scale - 0.5;
-                float value = nn_interpolate(im, x, y, k);
-                set_pixel(new_image, i, j, k, value);
-            }
-        }
-    }
+    image new_image = (im.type == IMAGE_F32) ? make_image_uninit(w, h, im.c) : make_image_typed(w, h, im.c, im.type);
+    nn_resize_into(im, new_image);
     return new_image;
 }
 
+void nn_resize_into(image im, image out)
+{
+    resize_with_plan(cached_resize_plan(im.w, im.h, out.w, out.h, RESIZE_NN), im, out);
+}
+
 float bilinear_interpolate(image im, float x, float y, int c)
 {
     int x1 = (int)floorf(x);
@@ -55,25 +68,181 @@ float bilinear_interpolate(image im, float x, float y, int c)
 
 image bilinear_resize(image im, int w, int h)
 {
-    image new_image = make_image(w, h, im.c);
+    image new_image = (im.type == IMAGE_F32) ? make_image_uninit(w, h, im.c) : make_image_typed(w, h, im.c, im.type);
+    bilinear_resize_into(im, new_image);
+    return new_image;
+}
 
-    float width_scale = (float)im.w / w;
-    float height_scale = (float)im.h / h;
+void bilinear_resize_into(image im, image out)
+{
+    resize_with_plan(cached_resize_plan(im.w, im.h, out.w, out.h, RESIZE_BILINEAR), im, out);
+}
 
-    for (int k = 0; k < im.c; k++) 
+// Fills the two taps for every output position along one axis.
+// Taps that fall outside the source get weight 0 (get_pixel pads with 0)
+// and an in-range index so the execute loop never needs a bounds check.
+static void make_resize_taps(int src, int dst, int method, int *index, float *weight)
+{
+    float scale = (float)src / dst;
+    for (int i = 0; i < dst; i++)
     {
-        for (int j = 0; j < h; j++)
+        float x = (i + 0.5) * scale - 0.5;
+        int x1, x2;
+        float w1, w2;
+        if (method == RESIZE_NN)
+        {
+            x1 = (int)roundf(x);
+            x2 = x1;
+            w1 = 1;
+            w2 = 0;
+        }
+        else
         {
-            for (int i = 0; i < w; i++) 
-            {
-                float x = (i + 0.5) * width_scale - 0.5;
-                float y = (j + 0.5) * height_scale - 0.5;
-                float value = bilinear_interpolate(im, x, y, k);
-                set_pixel(new_image, i, j, k, value);
-            }
+            x1 = (int)floorf(x);
+            x2 = x1 + 1;
+            w2 = x - x1;
+            w1 = 1 - w2;
         }
+        if (x1 < 0 || x1 >= src) { x1 = 0; w1 = 0; }
+        if (x2 < 0 || x2 >= src) { x2 = 0; w2 = 0; }
+        index[2*i] = x1;
+        index[2*i+1] = x2;
+        weight[2*i] = w1;
+        weight[2*i+1] = w2;
     }
+}
 
-    return new_image;
+resize_plan make_resize_plan(int src_w, int src_h, int dst_w, int dst_h, int method)
+{
+    resize_plan p;
+    p.src_w = src_w;
+    p.src_h = src_h;
+    p.dst_w = dst_w;
+    p.dst_h = dst_h;
+    p.method = method;
+    p.xi = calloc(2*dst_w, sizeof(int));
+    p.xw = calloc(2*dst_w, sizeof(float));
+    p.yi = calloc(2*dst_h, sizeof(int));
+    p.yw = calloc(2*dst_h, sizeof(float));
+    p.rows = calloc(3*dst_w + src_w, sizeof(float));
+    make_resize_taps(src_w, dst_w, method, p.xi, p.xw);
+    make_resize_taps(src_h, dst_h, method, p.yi, p.yw);
+    return p;
 }
 
+// Horizontal pass of one source row into dst_w samples
+static void resize_row(resize_plan p, const float *src, float *out)
+{
+    for (int i = 0; i < p.dst_w; i++)
+    {
+        out[i] = p.xw[2*i]*src[p.xi[2*i]] + p.xw[2*i+1]*src[p.xi[2*i+1]];
+    }
+}
+
+// Horizontal pass of one interleaved 8-bit row, channel k of src_c.
+// decode maps the 256 codes to floats, or is 0 for v/255.
+static void resize_row_u8(resize_plan p, const unsigned char *src, int src_c, int k, const float *decode, float *out)
+{
+    if (decode)
+    {
+        for (int i = 0; i < p.dst_w; i++)
+        {
+            out[i] = p.xw[2*i]*decode[src[p.xi[2*i]*src_c + k]] + p.xw[2*i+1]*decode[src[p.xi[2*i+1]*src_c + k]];
+        }
+        return;
+    }
+    for (int i = 0; i < p.dst_w; i++)
+    {
+        float v = p.xw[2*i]*src[p.xi[2*i]*src_c + k] + p.xw[2*i+1]*src[p.xi[2*i+1]*src_c + k];
+        out[i] = v * (1.f/255);
+    }
+}
+
+// Horizontal pass of row y of channel k, reading src in its own storage.
+// Half rows are widened whole first, converting each tap would cost more.
+static void resize_source_row(resize_plan p, image src, int y, int k, float *out)
+{
+    if (src.type == IMAGE_U8) resize_row_u8(p, image_ptr(src, 0, y, k), 1, 0, 0, out);
+    else if (src.type == IMAGE_F16)
+    {
+        float *wide = p.rows + 3*p.dst_w;
+        widen_row(src, y, k, wide);
+        resize_row(p, wide, out);
+    }
+    else resize_row(p, image_row(src, y, k), out);
+}
+
+// Runs the vertical pass of a plan over plane k of out. get_row resamples
+// source row y into the given buffer, so the same caching works for any
+// source storage. Compact output types are staged in the third scratch row.
+#define RESIZE_PLANE(p, out, k, get_row) do { \
+    int cached[2] = {-1, -1}; \
+    for (int j = 0; j < (p).dst_h; j++) \
+    { \
+        int y1 = (p).yi[2*j], y2 = (p).yi[2*j+1]; \
+        int s1 = (cached[0] == y1) ? 0 : ((cached[1] == y1) ? 1 : -1); \
+        if (s1 < 0) \
+        { \
+            s1 = (cached[0] == y2) ? 1 : 0; \
+            get_row(y1, (p).rows + s1*(p).dst_w); \
+            cached[s1] = y1; \
+        } \
+        int s2 = (cached[0] == y2) ? 0 : ((cached[1] == y2) ? 1 : -1); \
+        if (s2 < 0) \
+        { \
+            s2 = 1 - s1; \
+            get_row(y2, (p).rows + s2*(p).dst_w); \
+            cached[s2] = y2; \
+        } \
+        const float *r1 = (p).rows + s1*(p).dst_w; \
+        const float *r2 = (p).rows + s2*(p).dst_w; \
+        float w1 = (p).yw[2*j], w2 = (p).yw[2*j+1]; \
+        int typed = (out).type != IMAGE_F32; \
+        float *row = typed ? (p).rows + 2*(p).dst_w : image_row((out), j, (k)); \
+        for (int i = 0; i < (p).dst_w; i++) \
+        { \
+            row[i] = w1*r1[i] + w2*r2[i]; \
+        } \
+        if (typed) narrow_row((out), j, (k), row); \
+    } \
+} while (0)
+
+void resize_with_plan(resize_plan p, image src, image dst)
+{
+    assert(src.w == p.src_w && src.h == p.src_h);
+    assert(dst.w == p.dst_w && dst.h == p.dst_h && dst.c == src.c);
+    assert(src.layout == LAYOUT_CHW && dst.layout == LAYOUT_CHW);
+
+    for (int k = 0; k < src.c; k++)
+    {
+        // The scratch holds two resampled source rows; when upsampling
+        // consecutive output rows reuse them instead of redoing the pass.
+#define GET_ROW(y, buf) resize_source_row(p, src, (y), k, buf)
+        RESIZE_PLANE(p, dst, k, GET_ROW);
+#undef GET_ROW
+    }
+}
+
+void resize_u8_with_plan(resize_plan p, const unsigned char *src, int src_c, const float *decode, image dst)
+{
+    assert(dst.w == p.dst_w && dst.h == p.dst_h && dst.c <= src_c);
+    assert(dst.layout == LAYOUT_CHW);
+
+    for (int k = 0; k < dst.c; k++)
+    {
+        // Alpha is never sRGB decoded
+        const float *lut = is_alpha_channel(src_c, k) ? 0 : decode;
+#define GET_ROW(y, buf) resize_row_u8(p, src + (size_t)(y)*p.src_w*src_c, src_c, k, lut, buf)
+        RESIZE_PLANE(p, dst, k, GET_ROW);
+#undef GET_ROW
+    }
+}
+
+void free_resize_plan(resize_plan p)
+{
+    free(p.xi);
+    free(p.xw);
+    free(p.yi);
+    free(p.yw);
+    free(p.rows);
+}
@@ -1,7 +1,11 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <pthread.h>
 #include "image.h"
 #include "test.h"
 #include "args.h"
@@ -14,16 +18,22 @@ int within_eps(float a, float b){
 }
 
 int same_image(image a, image b){
-    int i;
+    int i,j,k;
     if(a.w != b.w || a.h != b.h || a.c != b.c) {
         printf("Expected %d x %d x %d image, got %d x %d x %d\n", b.w, b.h, b.c, a.w, a.h, a.c);
         return 0;
     }
-    for(i = 0; i < a.w*a.h*a.c; ++i){
-        if(!within_eps(a.data[i], b.data[i])) 
-        {
-            printf("The value should be %f, but it is %f! \n", b.data[i], a.data[i]);
-            return 0;
+    for(k = 0; k < a.c; ++k){
+        for(j = 0; j < a.h; ++j){
+            const float *ra = image_row(a, j, k), *rb = image_row(b, j, k);
+            for(i = 0; i < a.w; ++i){
+                float va = ra[i*a.step], vb = rb[i*b.step];
+                if(!within_eps(va, vb)) 
+                {
+                    printf("The value should be %f, but it is %f! \n", vb, va);
+                    return 0;
+                }
+            }
         }
     }
     return 1;
@@ -74,6 +84,62 @@ void test_grayscale()
     free_image(gt);
 }
 
+void test_grayscale_u8()
+{
+    image im = load_image("data/colorbar.png");
+    image gray = rgb_to_grayscale(im);
+    unsigned char rgb[3*256], rgba[4*256], y[256], ya[256];
+    int i;
+    for(i = 0; i < im.w; ++i){
+        rgb[3*i+0] = rgba[4*i+0] = roundf(255*get_pixel(im, i, 0, 0));
+        rgb[3*i+1] = rgba[4*i+1] = roundf(255*get_pixel(im, i, 0, 1));
+        rgb[3*i+2] = rgba[4*i+2] = roundf(255*get_pixel(im, i, 0, 2));
+        rgba[4*i+3] = i;
+    }
+    rgb_to_grayscale_u8(rgb, 3, y, im.w);
+    int off = 0;
+    for(i = 0; i < im.w; ++i){
+        off += abs(y[i] - (int)roundf(255*get_pixel(gray, i, 0, 0))) > 1;
+    }
+    TEST(off == 0);
+    // RGBA ignores alpha
+    rgb_to_grayscale_u8(rgba, 4, ya, im.w);
+    TEST(memcmp(ya, y, im.w) == 0);
+    free_image(im);
+    free_image(gray);
+}
+
+void test_linear_light()
+{
+    image im = load_image("data/dogsmall.jpg");
+    set_linear_light(1);
+    image lin = load_image("data/dogsmall.jpg");
+    int i, j, k, bad = 0;
+    for(k = 0; k < im.c; ++k){
+        for(j = 0; j < im.h; ++j){
+            for(i = 0; i < im.w; ++i){
+                float v = get_pixel(im, i, j, k);
+                float ref = (v <= .04045) ? v/12.92 : pow((v + .055)/1.055, 2.4);
+                bad += fabsf(get_pixel(lin, i, j, k) - ref) > 1e-6;
+            }
+        }
+    }
+    TEST(bad == 0);
+    for(i = 0, bad = 0; i < 256; ++i) bad += linear_to_srgb8(srgb8_to_linear(i)) != i;
+    TEST(bad == 0);
+
+    image thumb = load_image_resized("data/dogsmall.jpg", 40, 30);
+    image gt = bilinear_resize(lin, 40, 30);
+    TEST(same_image(thumb, gt));
+    set_linear_light(0);
+    TEST(within_eps(srgb8_to_linear(128), 128/255.));
+
+    free_image(im);
+    free_image(lin);
+    free_image(thumb);
+    free_image(gt);
+}
+
 void test_copy()
 {
     image gt = load_image("data/dog.jpg");
@@ -83,15 +149,364 @@ void test_copy()
     free_image(c);
 }
 
+void test_views()
+{
+    image im = load_image("data/dog.jpg");
+    image orig = copy_image(im);
+    image v = view_image(im, 10, 20, 64, 48);
+    TEST(v.w == 64 && v.h == 48 && v.c == im.c);
+    TEST(get_pixel(v, 3, 4, 1) == get_pixel(im, 13, 24, 1));
+    TEST(get_pixel(v, 64, 4, 1) == 0);
+
+    // Writes through the view land in the parent, and only inside it
+    shift_image(v, 1, .1);
+    TEST(within_eps(get_pixel(im, 13, 24, 1), get_pixel(orig, 13, 24, 1) + .1));
+    TEST(get_pixel(im, 9, 24, 1) == get_pixel(orig, 9, 24, 1));
+    TEST(get_pixel(im, 74, 24, 1) == get_pixel(orig, 74, 24, 1));
+
+    // Views read like the equivalent cropped copy
+    image crop = copy_image(v);
+    image f = make_box_filter(3);
+    image a = convolve_image(v, f, 1);
+    image b = convolve_image(crop, f, 1);
+    TEST(same_image(a, b));
+    free_image(v);
+
+    image g = view_channels(im, 1, 2);
+    TEST(g.c == 2 && get_pixel(g, 5, 5, 1) == get_pixel(im, 5, 5, 2));
+
+    // Tiles processed in place match processing the whole image
+    image whole = copy_image(im);
+    rgb_to_hsv(whole);
+    int tx, ty, tw = im.w/2, th = im.h/2;
+    for(ty = 0; ty < 2; ++ty){
+        for(tx = 0; tx < 2; ++tx){
+            int w = tx ? im.w - tw : tw, h = ty ? im.h - th : th;
+            rgb_to_hsv(view_image(im, tx*tw, ty*th, w, h));
+        }
+    }
+    TEST(same_image(im, whole));
+
+    free_image(im);
+    free_image(orig);
+    free_image(crop);
+    free_image(f);
+    free_image(a);
+    free_image(b);
+    free_image(whole);
+}
+
+void test_image_pool()
+{
+    // A freed buffer is handed back out, zeroed, for the next image of
+    // the same size
+    image a = make_image(100, 50, 3);
+    float *data = a.data;
+    set_pixel(a, 7, 8, 2, 1);
+    free_image(a);
+    a = make_image(100, 50, 3);
+    TEST(a.data == data);
+    TEST(get_pixel(a, 7, 8, 2) == 0);
+    TEST(((size_t)a.data & 63) == 0);
+    free_image(a);
+
+    image u = make_image_uninit(100, 50, 3);
+    TEST(u.data == data);
+    free_image(u);
+    clear_image_pool();
+}
+
+void test_padding()
+{
+    // Common sizes whose rows or planes would land on 1KB / 4KB multiples
+    int sizes[][2] = {{1920, 1080}, {640, 480}, {1024, 1024}, {256, 256}, {100, 100}};
+    int types[] = {IMAGE_F32, IMAGE_U8, IMAGE_F16};
+    int i, t, bad = 0;
+    for(i = 0; i < 5; ++i){
+        for(t = 0; t < 3; ++t){
+            image im = make_image_typed(sizes[i][0], sizes[i][1], 3, types[t]);
+            size_t size = image_elem_size(im.type);
+            size_t row = im.stride*size, plane = im.plane*size;
+            bad += row % 64 != 0;
+            bad += row >= 1024 && row % 1024 == 0;
+            bad += plane % 4096 == 0;
+            bad += im.plane < im.stride*im.h;
+            free_image(im);
+        }
+    }
+    TEST(bad == 0);
+}
+
+void test_layout()
+{
+    image im = load_image("data/dog.jpg");
+    image hwc = load_image_layout("data/dog.jpg", LAYOUT_HWC);
+    TEST(hwc.layout == LAYOUT_HWC && hwc.step == 3 && hwc.plane == 1);
+    TEST(same_image(hwc, im));
+
+    image planar = to_planar(hwc);
+    TEST(planar.layout == LAYOUT_CHW && same_image(planar, im));
+    image inter = to_interleaved(im);
+    TEST(inter.layout == LAYOUT_HWC && same_image(inter, im));
+
+    // Layout aware kernels give the planar results
+    image g1 = rgb_to_grayscale(im);
+    image g2 = rgb_to_grayscale(hwc);
+    TEST(same_image(g2, g1));
+    image s1 = add_image(im, hwc);
+    image s2 = add_image(hwc, hwc);
+    TEST(s2.layout == LAYOUT_HWC && same_image(s2, s1));
+    shift_image(hwc, 1, .1);
+    shift_image(im, 1, .1);
+    clamp_image(hwc);
+    clamp_image(im);
+    rgb_to_hsv(hwc);
+    rgb_to_hsv(im);
+    TEST(same_image(hwc, im));
+    hsv_to_rgb(hwc);
+    hsv_to_rgb(im);
+
+    image c = copy_image(hwc);
+    TEST(c.layout == LAYOUT_HWC && same_image(c, im));
+    image v = view_image(hwc, 30, 40, 20, 10);
+    TEST(get_pixel(v, 2, 3, 2) == get_pixel(im, 32, 43, 2));
+
+    // Interleaved images save and load without a transpose
+    save_png(hwc, "/tmp/uwimg_hwc");
+    save_png(im, "/tmp/uwimg_chw");
+    image back = load_image_layout("/tmp/uwimg_hwc.png", LAYOUT_HWC);
+    image ref = load_image("/tmp/uwimg_chw.png");
+    TEST(same_image(back, ref));
+
+    free_image(im);
+    free_image(hwc);
+    free_image(planar);
+    free_image(inter);
+    free_image(g1);
+    free_image(g2);
+    free_image(s1);
+    free_image(s2);
+    free_image(c);
+    free_image(back);
+    free_image(ref);
+}
+
+// Shares and drops the image at ctx many times
+static void *share_and_free(void *ctx)
+{
+    image im = *(image *)ctx;
+    for (int i = 0; i < 10000; i++)
+    {
+        image t = share_image(im);
+        free_image(t);
+    }
+    return 0;
+}
+
+static void equalize_256(image im)
+{
+    equalize_histogram(im, 256);
+}
+
+// Runs op on im in a child process and reports whether it aborted
+static int op_aborts(void (*op)(image), image im)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid == 0){
+        if(!freopen("/dev/null", "w", stderr)) _exit(0);
+        op(im);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFSIGNALED(status);
+}
+
+// Blurs the top left of im into a view of its own pixels
+static void blur_into_own_view(image im)
+{
+    image f = make_box_filter(3);
+    image v = view_image(im, 1, 1, im.w - 1, im.h - 1);
+    image src = view_image(im, 0, 0, im.w - 1, im.h - 1);
+    convolve_image_into(src, f, 1, v);
+}
+
+void test_into()
+{
+    image im = load_image("data/dog.jpg");
+    image out = make_image(im.w, im.h, im.c);
+
+    image ref = copy_image(im);
+    copy_image_into(im, out);
+    TEST(same_image(out, ref));
+    free_image(ref);
+
+    ref = add_image(im, im);
+    add_image_into(im, im, out);
+    TEST(same_image(out, ref));
+    // In place: out = out - im gives im back
+    sub_image_into(out, im, out);
+    TEST(same_image(out, im));
+    free_image(ref);
+
+    image f = make_box_filter(3);
+    ref = convolve_image(im, f, 1);
+    convolve_image_into(im, f, 1, out);
+    TEST(same_image(out, ref));
+    free_image(ref);
+    // Overlapping pixels are caught even when the data pointers differ
+    TEST(op_aborts(blur_into_own_view, out));
+
+    image gray = make_image(im.w, im.h, 1);
+    ref = rgb_to_grayscale(im);
+    rgb_to_grayscale_into(im, gray);
+    TEST(same_image(gray, ref));
+    free_image(ref);
+
+    // Into a view of a bigger image, and twice so the cached plan is reused
+    image big = make_image(400, 300, im.c);
+    image v = view_image(big, 50, 20, 300, 200);
+    ref = bilinear_resize(im, 300, 200);
+    bilinear_resize_into(im, v);
+    TEST(same_image(v, ref));
+    bilinear_resize_into(im, v);
+    TEST(same_image(v, ref));
+    free_image(ref);
+    ref = nn_resize(im, 300, 200);
+    nn_resize_into(im, v);
+    TEST(same_image(v, ref));
+    // The cached plan is rebuilt after being released
+    free_resize_cache();
+    nn_resize_into(im, v);
+    TEST(same_image(v, ref));
+    free_resize_cache();
+    free_image(ref);
+
+    free_image(im);
+    free_image(out);
+    free_image(f);
+    free_image(gray);
+    free_image(big);
+}
+
+void test_share()
+{
+    image im = load_image("data/dog.jpg");
+    image ref = copy_image(im);
+    TEST(ref.data != im.data && same_image(ref, im));
+
+    image s = share_image(im);
+    TEST(s.data == im.data && pool_refs(im.mem) == 2);
+    // Writing through a shared handle is caught rather than showing up in
+    // the other one
+    TEST(op_aborts(rgb_to_hsv, s));
+    TEST(op_aborts(clamp_image, s));
+    TEST(op_aborts(rgb_to_ycbcr, s));
+    TEST(op_aborts(equalize_256, s));
+    make_writable(&s);
+    TEST(!op_aborts(clamp_image, s));
+    TEST(s.data != im.data && pool_refs(im.mem) == 1 && pool_refs(s.mem) == 1);
+    rgb_to_hsv(s);
+    TEST(same_image(im, ref));
+    // The last holder of a buffer writes to it without copying
+    float *data = im.data;
+    make_writable(&im);
+    TEST(im.data == data);
+
+    // Handles shared and dropped from many threads keep the count right
+    #pragma omp parallel for
+    for (int i = 0; i < 1000; i++)
+    {
+        image t = share_image(im);
+        free_image(t);
+    }
+    TEST(pool_refs(im.mem) == 1);
+    // The same from plain threads, whether or not OpenMP is on
+    pthread_t threads[8];
+    for (int i = 0; i < 8; i++) pthread_create(&threads[i], 0, share_and_free, &im);
+    for (int i = 0; i < 8; i++) pthread_join(threads[i], 0);
+    TEST(pool_refs(im.mem) == 1);
+
+    image v = view_image(im, 10, 10, 50, 50);
+    image sv = share_image(v);
+    TEST(sv.mem && sv.data != v.data && same_image(sv, v));
+
+    free_image(im);
+    free_image(ref);
+    free_image(s);
+    free_image(sv);
+}
+
+void test_large_sizes()
+{
+    // 4.9 GP per plane, far past int. Only the sizes are checked, nothing
+    // is allocated.
+    image big = make_empty_image(70000, 70000, 3);
+    TEST(big.plane == (size_t)70000*70000);
+    TEST(image_bytes(big) == (size_t)70000*70000*3*sizeof(float));
+    TEST(image_size_ok(70000, 70000, 3, LAYOUT_CHW, IMAGE_F32));
+
+    // Sizes whose byte count overflows are refused before anything is
+    // multiplied out
+    TEST(!image_size_ok(-1, 10, 3, LAYOUT_CHW, IMAGE_F32));
+    TEST(!image_size_ok(1 << 30, 1 << 30, 1 << 30, LAYOUT_CHW, IMAGE_F32));
+    TEST(!image_size_ok(INT_MAX, INT_MAX, INT_MAX, LAYOUT_CHW, IMAGE_U8));
+    TEST(!image_size_ok(1 << 30, 1 << 30, 4, LAYOUT_CHW, IMAGE_F32));
+    TEST(image_size_ok(1 << 20, 1 << 20, 4, LAYOUT_CHW, IMAGE_U8));
+    // Planar rows pad a single pixel out to a whole line, so narrow images
+    // with many channels are far bigger than their interleaved form
+    TEST(!image_size_ok(1, INT_MAX, 1 << 28, LAYOUT_CHW, IMAGE_F32));
+    TEST(image_size_ok(1, INT_MAX, 1 << 28, LAYOUT_HWC, IMAGE_F32));
+    TEST(!image_size_ok(1 << 20, 1 << 30, 1 << 20, LAYOUT_HWC, IMAGE_F32));
+}
+
 void test_shift()
 {
     image im = load_image("data/dog.jpg");
     image c = copy_image(im);
     shift_image(c, 1, .1);
-    TEST(within_eps(c.data[0], im.data[0]));
-    TEST(within_eps(c.data[im.w*im.h + 13], im.data[im.w*im.h+13] + .1));
-    TEST(within_eps(c.data[2*im.w*im.h + 72], im.data[2*im.w*im.h+72]));
-    TEST(within_eps(c.data[im.w*im.h + 47], im.data[im.w*im.h+47] + .1));
+    TEST(within_eps(get_pixel(c, 0, 0, 0), get_pixel(im, 0, 0, 0)));
+    TEST(within_eps(get_pixel(c, 13, 0, 1), get_pixel(im, 13, 0, 1) + .1));
+    TEST(within_eps(get_pixel(c, 72, 0, 2), get_pixel(im, 72, 0, 2)));
+    TEST(within_eps(get_pixel(c, 47, 0, 1), get_pixel(im, 47, 0, 1) + .1));
+    free_image(im);
+    free_image(c);
+}
+
+void test_point_ops()
+{
+    image im = load_image("data/dog.jpg");
+    image c = copy_image(im);
+    scale_image(c, 2, .5);
+    TEST(within_eps(get_pixel(c, 72, 0, 2), .5*get_pixel(im, 72, 0, 2)));
+    TEST(within_eps(get_pixel(c, 13, 0, 0), get_pixel(im, 13, 0, 0)));
+    free_image(c);
+
+    // shift -> scale -> clamp on saturation, then a gamma on everything
+    c = copy_image(im);
+    shift_image(im, 1, .1);
+    scale_image(im, 1, 1.5);
+    clamp_image(im);
+    int i, j, k;
+    for(k = 0; k < im.c; ++k){
+        for(j = 0; j < im.h; ++j){
+            for(i = 0; i < im.w; ++i) set_pixel(im, i, j, k, powf(get_pixel(im, i, j, k), .8));
+        }
+    }
+
+    point_ops p = make_point_ops();
+    add_point_affine(&p, 1, 1, .1);
+    add_point_affine(&p, 1, 1.5, 0);
+    add_point_clamp(&p, -1, 0, 1);
+    add_point_gamma(&p, -1, .8);
+    TEST(p.n == 3);
+    apply_point_ops(c, p);
+    TEST(same_image(c, im));
+    free_point_ops(p);
+
+    threshold_image(c, .5);
+    TEST(get_pixel(c, 0, 0, 0) == (get_pixel(im, 0, 0, 0) > .5));
     free_image(im);
     free_image(c);
 }
@@ -117,6 +532,474 @@ void test_hsv_to_rgb()
     free_image(c);
 }
 
+void roundtrip_hsv(image im, void *ctx)
+{
+    rgb_to_hsv(im);
+    hsv_to_rgb(im);
+}
+
+void darken_green(image im, void *ctx)
+{
+    shift_image(im, 1, -.2);
+}
+
+void test_color_lut()
+{
+    image im = load_image("data/dog.jpg");
+    image c = copy_image(im);
+
+    color_lut lut = bake_color_lut(17, roundtrip_hsv, 0);
+    apply_color_lut(c, lut);
+    TEST(same_image(c, im));
+    free_color_lut(lut);
+
+    // Tetrahedral interpolation is exact for affine functions
+    lut = bake_color_lut(9, darken_green, 0);
+    apply_color_lut(c, lut);
+    shift_image(im, 1, -.2);
+    TEST(same_image(c, im));
+    free_color_lut(lut);
+
+    lut = load_cube_lut("data/invert.cube");
+    TEST(lut.size == 2);
+    clamp_image(c);
+    clamp_image(im);
+    apply_color_lut(c, lut);
+    int i, j, k;
+    for(k = 0; k < im.c; ++k){
+        for(j = 0; j < im.h; ++j){
+            for(i = 0; i < im.w; ++i) set_pixel(im, i, j, k, 1 - get_pixel(im, i, j, k));
+        }
+    }
+    TEST(same_image(c, im));
+    free_color_lut(lut);
+
+    free_image(im);
+    free_image(c);
+}
+
+// Published accuracy of the colour conversions, worst case over a 33^3
+// lattice of RGB colours against double precision references
+#define LAB_MAX_ERROR 1e-3
+#define LAB_ROUNDTRIP_ERROR 1e-4
+#define YCBCR_MAX_ERROR 1e-5
+#define YCBCR_ROUNDTRIP_ERROR 1e-5
+
+image make_rgb_lattice(int n)
+{
+    image im = make_image(n*n, n, 3);
+    int r, g, b;
+    for(b = 0; b < n; ++b){
+        for(g = 0; g < n; ++g){
+            for(r = 0; r < n; ++r){
+                set_pixel(im, g*n + r, b, 0, r/(n - 1.));
+                set_pixel(im, g*n + r, b, 1, g/(n - 1.));
+                set_pixel(im, g*n + r, b, 2, b/(n - 1.));
+            }
+        }
+    }
+    return im;
+}
+
+double max_image_error(image a, image b)
+{
+    double err = 0;
+    int i, j, k;
+    for(k = 0; k < a.c; ++k){
+        for(j = 0; j < a.h; ++j){
+            for(i = 0; i < a.w; ++i) err = fmax(err, fabs(get_pixel(a, i, j, k) - get_pixel(b, i, j, k)));
+        }
+    }
+    return err;
+}
+
+double srgb_decode_ref(double v)
+{
+    return v <= .04045 ? v/12.92 : pow((v + .055)/1.055, 2.4);
+}
+
+double lab_f_ref(double t)
+{
+    return t > 216./24389 ? cbrt(t) : (24389./27*t + 16)/116;
+}
+
+void test_ycbcr_lab()
+{
+    image im = make_rgb_lattice(33);
+    image ref = make_image(im.w, im.h, im.c);
+    image c = copy_image(im);
+    int x, y;
+
+    for(y = 0; y < im.h; ++y){
+        for(x = 0; x < im.w; ++x){
+            double R = get_pixel(im, x, y, 0), G = get_pixel(im, x, y, 1), B = get_pixel(im, x, y, 2);
+            double Y = .299*R + .587*G + .114*B;
+            set_pixel(ref, x, y, 0, Y);
+            set_pixel(ref, x, y, 1, (B - Y)/1.772 + .5);
+            set_pixel(ref, x, y, 2, (R - Y)/1.402 + .5);
+        }
+    }
+    rgb_to_ycbcr(c);
+    TEST(max_image_error(c, ref) < YCBCR_MAX_ERROR);
+    ycbcr_to_rgb(c);
+    TEST(max_image_error(c, im) < YCBCR_ROUNDTRIP_ERROR);
+
+    for(y = 0; y < im.h; ++y){
+        for(x = 0; x < im.w; ++x){
+            double R = srgb_decode_ref(get_pixel(im, x, y, 0));
+            double G = srgb_decode_ref(get_pixel(im, x, y, 1));
+            double B = srgb_decode_ref(get_pixel(im, x, y, 2));
+            double fx = lab_f_ref((.4124564*R + .3575761*G + .1804375*B)/.95047);
+            double fy = lab_f_ref(.2126729*R + .7151522*G + .0721750*B);
+            double fz = lab_f_ref((.0193339*R + .1191920*G + .9503041*B)/1.08883);
+            set_pixel(ref, x, y, 0, 116*fy - 16);
+            set_pixel(ref, x, y, 1, 500*(fx - fy));
+            set_pixel(ref, x, y, 2, 200*(fy - fz));
+        }
+    }
+    rgb_to_lab(c);
+    TEST(max_image_error(c, ref) < LAB_MAX_ERROR);
+    lab_to_rgb(c);
+    TEST(max_image_error(c, im) < LAB_ROUNDTRIP_ERROR);
+
+    // Linear light pixels are already decoded and give the same Lab
+    image lin = copy_image(im);
+    for(y = 0; y < im.h; ++y){
+        for(x = 0; x < im.w; ++x){
+            for(int k = 0; k < 3; ++k) set_pixel(lin, x, y, k, srgb_decode_ref(get_pixel(im, x, y, k)));
+        }
+    }
+    image lab = copy_image(lin);
+    set_linear_light(1);
+    rgb_to_lab(lab);
+    TEST(max_image_error(lab, ref) < LAB_MAX_ERROR);
+    lab_to_rgb(lab);
+    set_linear_light(0);
+    TEST(max_image_error(lab, lin) < LAB_ROUNDTRIP_ERROR);
+
+    free_image(lin);
+    free_image(lab);
+    free_image(im);
+    free_image(ref);
+    free_image(c);
+}
+
+void test_storage_types()
+{
+    TEST(float_to_half(1.f) == 0x3c00);
+    TEST(float_to_half(-2.f) == 0xc000);
+    TEST(float_to_half(65504.f) == 0x7bff);
+    TEST(float_to_half(1e6f) == 0x7c00);
+    TEST(half_to_float(0x0001) == 1.f/(1 << 24));
+    // Every finite half survives the trip through float
+    int bad = 0;
+    for (int h = 0; h < 0x10000; h++)
+    {
+        if ((h & 0x7c00) == 0x7c00) continue;
+        bad += float_to_half(half_to_float(h)) != h;
+    }
+    TEST(bad == 0);
+
+    image im = load_image("data/dog.jpg");
+    image u8 = convert_image(im, IMAGE_U8);
+    image f16 = convert_image(im, IMAGE_F16);
+    TEST(u8.type == IMAGE_U8 && f16.type == IMAGE_F16);
+    TEST(max_image_error(u8, im) < .5/255 + 1e-6);
+    TEST(max_image_error(f16, im) < 1e-3);
+
+    // Kernels on compact images track their float results
+    image r1 = bilinear_resize(im, 300, 200);
+    image r2 = bilinear_resize(f16, 300, 200);
+    TEST(r2.type == IMAGE_F16 && max_image_error(r2, r1) < 2e-3);
+    image r3 = bilinear_resize(u8, 300, 200);
+    TEST(r3.type == IMAGE_U8 && max_image_error(r3, r1) < 2.f/255);
+    image f = make_box_filter(3);
+    image b1 = convolve_image(im, f, 1);
+    image b2 = convolve_image(f16, f, 1);
+    TEST(b2.type == IMAGE_F16 && max_image_error(b2, b1) < 2e-3);
+    // 8-bit inputs widen, a highpass response goes negative
+    image hp = make_highpass_filter();
+    image e1 = convolve_image(im, hp, 1);
+    image e2 = convolve_image(u8, hp, 1);
+    TEST(e2.type == IMAGE_F32 && max_image_error(e2, e1) < 8.f/255);
+    float lowest = 0;
+    for (int i = 0; i < e2.w*e2.h*e2.c; i++) lowest = fminf(lowest, e2.data[i]);
+    TEST(lowest < -.1f);
+    image g1 = rgb_to_grayscale(im);
+    image g2 = rgb_to_grayscale(u8);
+    TEST(max_image_error(g2, g1) < 2.f/255);
+    // Copies keep both the layout and the storage type
+    image hu8 = make_image_uninit_typed(im.w, im.h, im.c, LAYOUT_HWC, IMAGE_U8);
+    copy_image_into(im, hu8);
+    image hc = copy_image(hu8);
+    TEST(hc.layout == LAYOUT_HWC && hc.type == IMAGE_U8 && max_image_error(hc, u8) == 0);
+    // Hue magnifies the input rounding where saturation is low
+    rgb_to_hsv(im);
+    rgb_to_hsv(f16);
+    TEST(max_image_error(f16, im) < 1e-2);
+    set_pixel(u8, 3, 4, 1, .5);
+    TEST(get_pixel(u8, 3, 4, 1) == 128/255.f);
+
+    free_image(im);
+    free_image(u8);
+    free_image(f16);
+    free_image(r1);
+    free_image(r2);
+    free_image(r3);
+    free_image(f);
+    free_image(b1);
+    free_image(b2);
+    free_image(hp);
+    free_image(e1);
+    free_image(e2);
+    free_image(g1);
+    free_image(g2);
+    free_image(hu8);
+    free_image(hc);
+}
+
+void brighten_tile(image tile, int x, int y, void *ctx)
+{
+    shift_image(tile, 0, *(float *)ctx);
+}
+
+void test_tiled()
+{
+    image im = load_image("data/dog.jpg");
+    // Few resident tiles, so every pass has to evict and map back in
+    tiled_image t = tile_image(im, 64, 4);
+    TEST(t.tiles_x == 12 && t.tiles_y == 9);
+    image back = untile_image(t);
+    TEST(same_image(back, im));
+
+    // Windows hanging off the image read zeros there
+    image win = make_image(40, 30, 3);
+    read_tiled_region(t, -10, 560, win);
+    TEST(get_pixel(win, 5, 5, 0) == 0 && get_pixel(win, 20, 25, 1) == 0);
+    TEST(get_pixel(win, 12, 3, 2) == get_pixel(im, 2, 563, 2));
+
+    float shift = .1;
+    for_each_tile(t, brighten_tile, &shift);
+    free_image(back);
+    back = untile_image(t);
+    TEST(within_eps(get_pixel(back, 700, 500, 0), get_pixel(im, 700, 500, 0) + .1));
+    TEST(within_eps(get_pixel(back, 700, 500, 1), get_pixel(im, 700, 500, 1)));
+    shift = -.1;
+    for_each_tile(t, brighten_tile, &shift);
+
+    image f = make_gaussian_filter(2);
+    image blur = convolve_image(im, f, 1);
+    tiled_image tblur = make_tiled_image(im.w, im.h, im.c, 64, 4);
+    convolve_tiled(t, f, 1, tblur);
+    image tb = untile_image(tblur);
+    TEST(max_image_error(tb, blur) < 1e-5);
+    // Output tiles bigger than the input ones
+    tiled_image tblur2 = make_tiled_image(im.w, im.h, im.c, 128, 4);
+    convolve_tiled(t, f, 1, tblur2);
+    image tb2 = untile_image(tblur2);
+    TEST(max_image_error(tb2, blur) < 1e-5);
+    free_image(tb2);
+    free_tiled_image(tblur2);
+
+    image small = bilinear_resize(im, 300, 200);
+    tiled_image tsmall = make_tiled_image(300, 200, im.c, 64, 4);
+    resize_tiled(t, tsmall, RESIZE_BILINEAR);
+    image ts = untile_image(tsmall);
+    TEST(max_image_error(ts, small) < 1e-5);
+    image big = nn_resize(im, 1000, 700);
+    tiled_image tbig = make_tiled_image(1000, 700, im.c, 128, 4);
+    resize_tiled(t, tbig, RESIZE_NN);
+    image tg = untile_image(tbig);
+    TEST(same_image(tg, big));
+    // A steep downscale and a bilinear upscale, where taps repeat
+    image tiny = bilinear_resize(im, 37, 29);
+    tiled_image ttiny = make_tiled_image(37, 29, im.c, 16, 4);
+    resize_tiled(t, ttiny, RESIZE_BILINEAR);
+    image tt2 = untile_image(ttiny);
+    TEST(max_image_error(tt2, tiny) < 1e-5);
+    image up = bilinear_resize(im, 1100, 900);
+    tiled_image tup = make_tiled_image(1100, 900, im.c, 100, 4);
+    resize_tiled(t, tup, RESIZE_BILINEAR);
+    image tu = untile_image(tup);
+    TEST(max_image_error(tu, up) < 1e-5);
+    free_image(tiny);
+    free_image(tt2);
+    free_image(up);
+    free_image(tu);
+    free_tiled_image(ttiny);
+    free_tiled_image(tup);
+
+    // Scratch files can go anywhere, not just the temp directory
+    set_tile_scratch_dir(".");
+    tiled_image there = tile_image(im, 128, 2);
+    set_tile_scratch_dir(0);
+    image tt = untile_image(there);
+    TEST(same_image(tt, im));
+    free_image(tt);
+    free_tiled_image(there);
+
+    free_image(im);
+    free_image(back);
+    free_image(win);
+    free_image(f);
+    free_image(blur);
+    free_image(tb);
+    free_image(small);
+    free_image(ts);
+    free_image(big);
+    free_image(tg);
+    free_tiled_image(t);
+    free_tiled_image(tblur);
+    free_tiled_image(tsmall);
+    free_tiled_image(tbig);
+}
+
+void test_alpha()
+{
+    // Dropped alpha takes no memory
+    image im = load_image("data/dots.png");
+    TEST(im.c == 3 && image_bytes(im) == im.plane*3*sizeof(float));
+
+    image rgba = load_image_rgba("data/dots.png");
+    TEST(rgba.c == 4);
+    double err = 0;
+    int x, y, k;
+    for(y = 0; y < im.h; ++y) for(x = 0; x < im.w; ++x) for(k = 0; k < 3; ++k){
+        err = fmax(err, fabs(get_pixel(rgba, x, y, k) - get_pixel(im, x, y, k)*get_pixel(rgba, x, y, 3)));
+    }
+    TEST(err < 1e-6);
+
+    // Saving divides alpha back out, so the file reloads the same
+    save_png(rgba, "/tmp/uwimg_rgba");
+    image back = load_image_rgba("/tmp/uwimg_rgba.png");
+    TEST(max_image_error(back, rgba) < 1e-5);
+
+    // Resizing premultiplied pixels doesn't darken towards transparency:
+    // halfway between opaque red and clear is red at half alpha
+    image edge = make_image(2, 1, 4);
+    set_pixel(edge, 0, 0, 0, 1);
+    set_pixel(edge, 0, 0, 3, 1);
+    image mid = bilinear_resize(edge, 3, 1);
+    unpremultiply_alpha(mid);
+    TEST(within_eps(get_pixel(mid, 1, 0, 0), 1) && within_eps(get_pixel(mid, 1, 0, 3), .5));
+    TEST(within_eps(get_pixel(mid, 1, 0, 1), 0));
+
+    // Gray and alpha files keep their alpha linear in linear light, planar
+    // or interleaved
+    image ga = make_image(4, 1, 2);
+    for(x = 0; x < 4; ++x){
+        set_pixel(ga, x, 0, 0, x/3.);
+        set_pixel(ga, x, 0, 1, (x + 1)/8.);
+    }
+    image ga_hwc = to_interleaved(ga);
+    set_linear_light(1);
+    save_png(ga, "/tmp/uwimg_ga");
+    save_png(ga_hwc, "/tmp/uwimg_ga_hwc");
+    image ga_back = load_image("/tmp/uwimg_ga.png");
+    image ga_back_hwc = load_image("/tmp/uwimg_ga_hwc.png");
+    set_linear_light(0);
+    image ga_raw = load_image("/tmp/uwimg_ga.png");
+    TEST(ga_back.c == 2 && max_image_error(ga_back, ga) < 1e-2);
+    TEST(max_image_error(ga_back_hwc, ga) < 1e-2);
+    err = 0;
+    for(x = 0; x < 4; ++x) err = fmax(err, fabs(get_pixel(ga_raw, x, 0, 1) - (x + 1)/8.));
+    TEST(err < .5/255 + 1e-6);
+
+    free_image(ga);
+    free_image(ga_hwc);
+    free_image(ga_back);
+    free_image(ga_back_hwc);
+    free_image(ga_raw);
+    free_image(im);
+    free_image(rgba);
+    free_image(back);
+    free_image(edge);
+    free_image(mid);
+}
+
+void test_histogram()
+{
+    image im = make_image(10, 10, 2);
+    int i;
+    for(i = 0; i < 100; ++i){
+        set_pixel(im, i % 10, i / 10, 0, (i % 4) / 4.);
+        set_pixel(im, i % 10, i / 10, 1, (i < 30) ? -1 : 2);
+    }
+    histogram h = make_histogram(im, 4, 0, 1);
+    TEST(h.counts[0] == 25 && h.counts[1] == 25 && h.counts[2] == 25 && h.counts[3] == 25);
+    TEST(h.counts[4] == 30 && h.counts[7] == 70);
+    free_histogram(h);
+    free_image(im);
+
+    // More than 2^32 pixels in one bin: a flat 66000 x 66000 plane, every
+    // row reading the same buffer
+    image row = make_image(66000, 1, 1);
+    image flat = row;
+    flat.h = 66000;
+    flat.stride = 0;
+    h = make_histogram(flat, 2, 0, 1);
+    TEST(h.counts[0] == (uint64_t)66000*66000 && h.counts[1] == 0);
+    free_histogram(h);
+    free_image(row);
+
+    // A dim image gets stretched over the whole range
+    im = load_image("data/dog.jpg");
+    scale_image(im, 0, .3);
+    scale_image(im, 1, .3);
+    scale_image(im, 2, .3);
+    equalize_histogram(im, 256);
+    h = make_histogram(im, 256, 0, 1);
+    TEST(h.counts[0] > 0 && h.counts[255] > 0);
+    int low = 0;
+    for(i = 0; i < 128; ++i) low += h.counts[i];
+    TEST(abs(low - im.w*im.h/2) < im.w*im.h/20);
+    free_histogram(h);
+    free_image(im);
+}
+
+void test_clahe()
+{
+    // One tile with no clipping is plain equalization
+    image im = load_image("data/dog.jpg");
+    image c = copy_image(im);
+    equalize_histogram(im, CLAHE_BINS);
+    clahe_image(c, 1, 1, 1000);
+    TEST(same_image(c, im));
+    free_image(c);
+    free_image(im);
+
+    // A dim image gains local contrast and stays in range
+    im = load_image("data/dog.jpg");
+    scale_image(im, 0, .2);
+    scale_image(im, 1, .2);
+    scale_image(im, 2, .2);
+    clahe_image(im, 8, 8, 2);
+    histogram h = make_histogram(im, 4, 0, 1);
+    TEST(h.counts[1] + h.counts[2] + h.counts[3] > im.w*im.h/4);
+    int i, j, k, bad = 0;
+    for(k = 0; k < im.c; ++k){
+        for(j = 0; j < im.h; ++j){
+            const float *row = image_row(im, j, k);
+            for(i = 0; i < im.w; ++i) bad += row[i] < 0 || row[i] > 1;
+        }
+    }
+    TEST(bad == 0);
+    free_histogram(h);
+    free_image(im);
+
+    // A width that doesn't split evenly into tiles still gives every tile
+    // pixels: each holds the brightest value, so it maps to 1 everywhere
+    im = make_image(10, 10, 1);
+    for(j = 0; j < im.h; ++j){
+        for(i = 0; i < im.w; ++i) set_pixel(im, i, j, 0, j ? (i + j)/20. : 1);
+    }
+    clahe_image(im, 6, 1, 1000);
+    bad = 0;
+    for(i = 0; i < im.w; ++i) bad += !within_eps(get_pixel(im, i, 0, 0), 1);
+    TEST(bad == 0);
+    free_image(im);
+}
+
 void test_nn_resize()
 {
     image im = load_image("data/dogsmall.jpg");
@@ -172,6 +1055,203 @@ void test_multiple_resize()
     free_image(gt);
 }
 
+image reference_resize(image im, int w, int h, int method)
+{
+    image out = make_image(w, h, im.c);
+    int i, j, k;
+    for(k = 0; k < im.c; ++k){
+        for(j = 0; j < h; ++j){
+            for(i = 0; i < w; ++i){
+                float x = (i + 0.5) * ((float)im.w / w) - 0.5;
+                float y = (j + 0.5) * ((float)im.h / h) - 0.5;
+                float v = (method == RESIZE_NN) ? nn_interpolate(im, x, y, k) : bilinear_interpolate(im, x, y, k);
+                set_pixel(out, i, j, k, v);
+            }
+        }
+    }
+    return out;
+}
+
+void test_resize_plan()
+{
+    image im = load_image("data/dog.jpg");
+    image gt = reference_resize(im, 713, 467, RESIZE_BILINEAR);
+    image out = make_image(713, 467, im.c);
+    resize_plan p = make_resize_plan(im.w, im.h, 713, 467, RESIZE_BILINEAR);
+    resize_with_plan(p, im, out);
+    resize_with_plan(p, im, out);
+    TEST(same_image(out, gt));
+    free_resize_plan(p);
+    free_image(gt);
+    free_image(out);
+
+    gt = reference_resize(im, im.w/3, im.h/3, RESIZE_NN);
+    out = make_image(im.w/3, im.h/3, im.c);
+    p = make_resize_plan(im.w, im.h, im.w/3, im.h/3, RESIZE_NN);
+    resize_with_plan(p, im, out);
+    TEST(same_image(out, gt));
+    free_resize_plan(p);
+    free_image(gt);
+    free_image(out);
+
+    gt = reference_resize(im, im.w*4, im.h*4, RESIZE_BILINEAR);
+    out = bilinear_resize(im, im.w*4, im.h*4);
+    TEST(same_image(out, gt));
+    free_image(gt);
+    free_image(out);
+    free_image(im);
+}
+
+void test_load_resized()
+{
+    image im = load_image("data/dog.jpg");
+    image gt = bilinear_resize(im, im.w/5, im.h/5);
+    image thumb = load_image_resized("data/dog.jpg", im.w/5, im.h/5);
+    TEST(same_image(thumb, gt));
+    free_image(im);
+    free_image(gt);
+    free_image(thumb);
+
+    im = load_image("data/aria.png");
+    gt = bilinear_resize(im, 333, 77);
+    thumb = load_image_resized("data/aria.png", 333, 77);
+    TEST(same_image(thumb, gt));
+    free_image(im);
+    free_image(gt);
+    free_image(thumb);
+}
+
+void test_warp_affine()
+{
+    image im = load_image("data/dogsmall.jpg");
+    float identity[6] = {1, 0, 0, 0, 1, 0};
+    image same = warp_affine(im, identity, im.w, im.h, RESIZE_BILINEAR, 0);
+    TEST(same_image(same, im));
+    free_image(same);
+
+    // Quarter turn: source (x, y) lands on (h-1-y, x)
+    float quarter[6] = {0, -1, im.h-1, 1, 0, 0};
+    image gt = make_image(im.h, im.w, im.c);
+    int i, j, k;
+    for(k = 0; k < im.c; ++k){
+        for(j = 0; j < im.h; ++j){
+            for(i = 0; i < im.w; ++i){
+                set_pixel(gt, im.h-1-j, i, k, get_pixel(im, i, j, k));
+            }
+        }
+    }
+    image nn = warp_affine(im, quarter, im.h, im.w, RESIZE_NN, 0);
+    image bl = warp_affine(im, quarter, im.h, im.w, RESIZE_BILINEAR, 0);
+    TEST(same_image(nn, gt));
+    TEST(same_image(bl, gt));
+    free_image(nn);
+    free_image(bl);
+    free_image(gt);
+
+    // Corners of a 45 degree rotation come from outside the source
+    image rot = rotate_image(im, M_PI/4, RESIZE_BILINEAR);
+    float inv[6];
+    make_rotation_affine(inv, -M_PI/4, (im.w-1)/2., (im.h-1)/2.);
+    TEST(within_eps(get_pixel(rot, 0, 0, 0), 0));
+    for(i = im.w/4; i < 3*im.w/4; i += 7){
+        j = im.h/2;
+        float x = inv[0]*i + inv[1]*j + inv[2];
+        float y = inv[3]*i + inv[4]*j + inv[5];
+        TEST(within_eps(get_pixel(rot, i, j, 1), bilinear_interpolate(im, x, y, 1)));
+    }
+    free_image(rot);
+    free_image(im);
+
+    // Float rotation matrices have tiny nonzero terms where an exact one
+    // has zeros; every pixel of a square must still be covered
+    image ones = make_image(400, 400, 1);
+    shift_image(ones, 0, 1);
+    float turns[3] = {M_PI/2, M_PI, 3*M_PI/2};
+    for(k = 0; k < 3; ++k){
+        for(int m = RESIZE_NN; m <= RESIZE_BILINEAR; ++m){
+            image r = rotate_image(ones, turns[k], m);
+            int covered = 0;
+            for(j = 0; j < r.h; ++j) for(i = 0; i < r.w; ++i) covered += within_eps(get_pixel(r, i, j, 0), 1);
+            TEST(covered == 400*400);
+            free_image(r);
+        }
+    }
+    free_image(ones);
+}
+
+void half_pixel_shift(float x, float y, float *sx, float *sy, void *ctx)
+{
+    *sx = x + .5;
+    *sy = y - .5;
+}
+
+void test_remap()
+{
+    image im = load_image("data/dogsmall.jpg");
+    image gt = make_image(im.w, im.h, im.c);
+    int i, j, k;
+    for(k = 0; k < im.c; ++k){
+        for(j = 0; j < im.h; ++j){
+            for(i = 0; i < im.w; ++i){
+                set_pixel(gt, i, j, k, bilinear_interpolate(im, i + .5, j - .5, k));
+            }
+        }
+    }
+    image out = make_image(im.w, im.h, im.c);
+    remap_map map = make_remap(im.w, im.h, half_pixel_shift, 0, REMAP_FLOAT);
+    remap_image(im, out, map);
+    TEST(same_image(out, gt));
+    free_remap(map);
+
+    map = make_remap(im.w, im.h, half_pixel_shift, 0, REMAP_FIXED);
+    remap_image(im, out, map);
+    TEST(same_image(out, gt));
+    free_remap(map);
+
+    // No distortion is the identity
+    map = make_undistort_remap(im.w, im.h, 0, 0, REMAP_FIXED);
+    remap_image(im, out, map);
+    TEST(same_image(out, im));
+    free_remap(map);
+
+    free_image(out);
+    free_image(gt);
+    free_image(im);
+}
+
+void test_pyramid()
+{
+    image im = load_image("data/dogsmall.jpg");
+    image_pyramid p = make_image_pyramid(im, 0);
+    TEST(p.levels[p.n-1].w == 1 && p.levels[p.n-1].h == 1);
+    TEST(same_image(p.levels[0], im));
+
+    // Level 1 against a direct 5x5 binomial filter and decimate
+    float k[5] = {1/16., 4/16., 6/16., 4/16., 1/16.};
+    image gt = make_image((im.w+1)/2, (im.h+1)/2, im.c);
+    int i, j, c, dx, dy;
+    for(c = 0; c < gt.c; ++c){
+        for(j = 0; j < gt.h; ++j){
+            for(i = 0; i < gt.w; ++i){
+                float sum = 0;
+                for(dy = -2; dy <= 2; ++dy){
+                    for(dx = -2; dx <= 2; ++dx){
+                        int x = 2*i + dx, y = 2*j + dy;
+                        x = x < 0 ? 0 : (x >= im.w ? im.w-1 : x);
+                        y = y < 0 ? 0 : (y >= im.h ? im.h-1 : y);
+                        sum += k[dx+2]*k[dy+2]*get_pixel(im, x, y, c);
+                    }
+                }
+                set_pixel(gt, i, j, c, sum);
+            }
+        }
+    }
+    TEST(same_image(p.levels[1], gt));
+    TEST(p.levels[2].w == (gt.w+1)/2 && p.levels[2].h == (gt.h+1)/2);
+    free_image(gt);
+    free_image_pyramid(p);
+    free_image(im);
+}
 
 void test_highpass_filter(){
     image im = load_image("data/dog.jpg");
@@ -234,11 +1314,7 @@ void test_convolution(){
 
 void test_gaussian_filter(){
     image f = make_gaussian_filter(7);
-    int i;
-
-    for(i = 0; i < f.w * f.h * f.c; i++){
-        f.data[i] *= 100;
-    }
+    scale_image(f, 0, 100);
 
     image gt = load_image("figs/gaussian_filter_7.png");
     TEST(same_image(f, gt));    
@@ -321,15 +1397,18 @@ void test_sobel(){
     if( gt_mag.w != mag.w || gt_theta.w != theta.w || 
         gt_mag.h != mag.h || gt_theta.h != theta.h || 
         gt_mag.c != mag.c || gt_theta.c != theta.c ) return;
-    int i;
-    for(i = 0; i < gt_mag.w*gt_mag.h; ++i){
-        if(within_eps(gt_mag.data[i], 0)){
-            gt_theta.data[i] = 0;
-            theta.data[i] = 0;
-        }
-        if(within_eps(gt_theta.data[i], 0) || within_eps(gt_theta.data[i], 1)){
-            gt_theta.data[i] = 0;
-            theta.data[i] = 0;
+    int i, j;
+    for(j = 0; j < gt_mag.h; ++j){
+        for(i = 0; i < gt_mag.w; ++i){
+            if(within_eps(get_pixel(gt_mag, i, j, 0), 0)){
+                set_pixel(gt_theta, i, j, 0, 0);
+                set_pixel(theta, i, j, 0, 0);
+            }
+            float t = get_pixel(gt_theta, i, j, 0);
+            if(within_eps(t, 0) || within_eps(t, 1)){
+                set_pixel(gt_theta, i, j, 0, 0);
+                set_pixel(theta, i, j, 0, 0);
+            }
         }
     }
 
@@ -357,13 +1436,35 @@ void run_tests()
     test_get_pixel();
     test_set_pixel();
     test_copy();
+    test_views();
+    test_image_pool();
+    test_padding();
+    test_layout();
+    test_storage_types();
+    test_into();
+    test_share();
+    test_large_sizes();
+    test_tiled();
+    test_alpha();
     test_shift();
     test_grayscale();
+    test_grayscale_u8();
+    test_linear_light();
+    test_point_ops();
     test_rgb_to_hsv();
     test_hsv_to_rgb();
+    test_color_lut();
+    test_ycbcr_lab();
+    test_histogram();
+    test_clahe();
     test_nn_resize();
     test_bl_resize();
     test_multiple_resize();
+    test_resize_plan();
+    test_load_resized();
+    test_warp_affine();
+    test_remap();
+    test_pyramid();
     test_gaussian_filter();
     test_sharpen_filter();
     test_emboss_filter();
@@ -9,4 +9,5 @@ extern int tests_fail;
     ++tests_fail; }} while (0)
 
 void run_tests();
+void run_benchmarks();
 #endif
@@ -0,0 +1,66 @@
+// Checks the fused expressions of image_expr.hpp against the C kernels
+#include <cmath>
+#include "image_expr.hpp"
+#include "test.h"
+
+using namespace uwimg;
+
+static float max_error(image a, image b)
+{
+    float m = 0;
+    for (int c = 0; c < a.c; c++)
+        for (int y = 0; y < a.h; y++)
+            for (int x = 0; x < a.w; x++)
+                m = fmaxf(m, fabsf(get_pixel(a, x, y, c) - get_pixel(b, x, y, c)));
+    return m;
+}
+
+void test_fused()
+{
+    char dog[] = "data/dog.jpg";
+    image a = load_image(dog);
+    image f = make_box_filter(5);
+    image b = convolve_image(a, f, 1);
+    image c = copy_image(a);
+    rgb_to_hsv(c);
+
+    // a + (b - c) * .5 in one pass, against three C kernels
+    image e = eval(a + (b - c) * 0.5f);
+    image d = sub_image(b, c);
+    for (int k = 0; k < d.c; k++) scale_image(d, k, .5f);
+    image ref = add_image(a, d);
+    TEST(e.w == a.w && e.h == a.h && e.c == a.c);
+    TEST(max_error(e, ref) < 1e-5f);
+
+    // Scalars on either side
+    image s = eval(1.f - a / 2.f);
+    image t = copy_image(a);
+    for (int k = 0; k < t.c; k++) { scale_image(t, k, -.5f); shift_image(t, k, 1); }
+    TEST(max_error(s, t) < 1e-5f);
+
+    // Writing into an operand
+    image g = copy_image(a);
+    assign(g, g - b);
+    image gref = sub_image(a, b);
+    TEST(max_error(g, gref) < 1e-6f);
+
+    // Interleaved operands and views
+    image h = to_interleaved(b);
+    image sum = eval(a + h);
+    image sref = add_image(a, b);
+    TEST(max_error(sum, sref) < 1e-6f);
+    image va = view_image(a, 10, 20, 50, 40), vb = view_image(b, 10, 20, 50, 40);
+    image prod = eval(va * vb);
+    TEST(prod.w == 50 && prod.h == 40);
+    TEST(fabsf(get_pixel(prod, 3, 4, 1) - get_pixel(a, 13, 24, 1)*get_pixel(b, 13, 24, 1)) < 1e-6f);
+
+    image imgs[] = {a, f, b, c, e, d, ref, s, t, g, gref, h, sum, sref, prod};
+    for (image im : imgs) free_image(im);
+}
+
+int main()
+{
+    test_fused();
+    printf("%d tests, %d passed, %d failed\n", tests_total, tests_total-tests_fail, tests_fail);
+    return tests_fail != 0;
+}
@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "image.h"
+
+// Tiled images live in an unlinked scratch file, one page aligned block
+// per tile in row-major tile order, so sweeping the tiles in order reads
+// and writes the file sequentially. Only the tiles in use are mapped.
+
+typedef struct{
+    int tile, pins;
+    unsigned long last;
+    float *data;
+} tile_slot;
+
+struct tile_cache{
+    int fd;
+    size_t tile_bytes;
+    int max_resident;
+    int *slot_of;
+    tile_slot *slots;
+    unsigned long clock;
+};
+
+// Where scratch files go, 0 for $TMPDIR or /tmp
+static char *scratch_dir = 0;
+
+void set_tile_scratch_dir(const char *dir)
+{
+    free(scratch_dir);
+    scratch_dir = dir ? strdup(dir) : 0;
+}
+
+// An empty scratch file of the given size that goes away with its fd
+static int open_scratch_file(size_t bytes)
+{
+    const char *dir = scratch_dir ? scratch_dir : getenv("TMPDIR");
+    if (!dir) dir = "/tmp";
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/uwimg-tiles-XXXXXX", dir);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create tile scratch file in %s\n", dir);
+        exit(1);
+    }
+    unlink(path);
+    if (ftruncate(fd, (off_t)bytes)) {
+        fprintf(stderr, "Cannot grow tile scratch file to %zu bytes\n", bytes);
+        exit(1);
+    }
+    return fd;
+}
+
+tiled_image make_tiled_image(int w, int h, int c, int tile, int max_resident)
+{
+    assert(w > 0 && h > 0 && c > 0 && tile > 0 && max_resident > 0);
+    tiled_image t;
+    t.w = w;
+    t.h = h;
+    t.c = c;
+    t.tile = tile;
+    t.tiles_x = (w + tile - 1) / tile;
+    t.tiles_y = (h + tile - 1) / tile;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t ntiles = (size_t)t.tiles_x*t.tiles_y;
+    tile_cache *cache = calloc(1, sizeof(tile_cache));
+    cache->tile_bytes = ((size_t)tile*tile*c*sizeof(float) + page - 1) / page * page;
+    cache->fd = open_scratch_file(ntiles*cache->tile_bytes);
+    cache->max_resident = max_resident;
+    cache->slot_of = malloc(ntiles*sizeof(int));
+    for (size_t i = 0; i < ntiles; i++) cache->slot_of[i] = -1;
+    cache->slots = calloc(max_resident, sizeof(tile_slot));
+    for (int s = 0; s < max_resident; s++) cache->slots[s].tile = -1;
+    t.cache = cache;
+    return t;
+}
+
+void free_tiled_image(tiled_image t)
+{
+    tile_cache *cache = t.cache;
+    for (int s = 0; s < cache->max_resident; s++)
+    {
+        if (cache->slots[s].tile >= 0) munmap(cache->slots[s].data, cache->tile_bytes);
+    }
+    close(cache->fd);
+    free(cache->slot_of);
+    free(cache->slots);
+    free(cache);
+}
+
+// The slot to map a new tile into: a free one, else the least recently
+// used tile nobody holds
+static int evict_slot(tile_cache *cache)
+{
+    int best = -1;
+    for (int s = 0; s < cache->max_resident; s++)
+    {
+        tile_slot *slot = cache->slots + s;
+        if (slot->tile < 0) return s;
+        if (slot->pins == 0 && (best < 0 || slot->last < cache->slots[best].last)) best = s;
+    }
+    if (best < 0) {
+        fprintf(stderr, "All %d resident tiles are in use\n", cache->max_resident);
+        exit(1);
+    }
+    // The mapping is shared, so the pixels are already in the file
+    tile_slot *slot = cache->slots + best;
+    munmap(slot->data, cache->tile_bytes);
+    cache->slot_of[slot->tile] = -1;
+    slot->tile = -1;
+    return best;
+}
+
+// Tile (tx, ty) as a planar image, mapped in if needed. The view stays
+// valid until the matching release_tile.
+image acquire_tile(tiled_image t, int tx, int ty)
+{
+    assert(tx >= 0 && tx < t.tiles_x && ty >= 0 && ty < t.tiles_y);
+    tile_cache *cache = t.cache;
+    int idx = ty*t.tiles_x + tx;
+    int s = cache->slot_of[idx];
+    if (s < 0)
+    {
+        s = evict_slot(cache);
+        off_t offset = (off_t)idx*cache->tile_bytes;
+        void *p = mmap(0, cache->tile_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, offset);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "Cannot map tile %d, %d\n", tx, ty);
+            exit(1);
+        }
+        cache->slots[s].data = p;
+        cache->slots[s].tile = idx;
+        cache->slot_of[idx] = s;
+    }
+    tile_slot *slot = cache->slots + s;
+    slot->pins++;
+    slot->last = ++cache->clock;
+
+    int x0 = tx*t.tile, y0 = ty*t.tile;
+    image tile = make_empty_image((x0 + t.tile < t.w) ? t.tile : t.w - x0,
+                                  (y0 + t.tile < t.h) ? t.tile : t.h - y0, t.c);
+    tile.data = slot->data;
+    tile.stride = t.tile;
+    tile.plane = (size_t)t.tile*t.tile;
+    return tile;
+}
+
+void release_tile(tiled_image t, int tx, int ty)
+{
+    tile_cache *cache = t.cache;
+    int s = cache->slot_of[ty*t.tiles_x + tx];
+    assert(s >= 0 && cache->slots[s].pins > 0);
+    cache->slots[s].pins--;
+}
+
+void for_each_tile(tiled_image t, tile_fn fn, void *ctx)
+{
+    for (int ty = 0; ty < t.tiles_y; ty++)
+    {
+        for (int tx = 0; tx < t.tiles_x; tx++)
+        {
+            image tile = acquire_tile(t, tx, ty);
+            fn(tile, tx*t.tile, ty*t.tile, ctx);
+            release_tile(t, tx, ty);
+        }
+    }
+}
+
+// Copies between the out.w x out.h window of t at (x, y) and out, a tile
+// at a time. Reading zero fills whatever falls outside t.
+static void tiled_region(tiled_image t, int x, int y, image out, int write)
+{
+    assert(out.c == t.c && out.type == IMAGE_F32 && out.step == 1);
+    if (!write)
+    {
+        for (int c = 0; c < out.c; c++)
+        {
+            for (int j = 0; j < out.h; j++)
+            {
+                float *row = image_row(out, j, c);
+                int sy = y + j;
+                if (sy < 0 || sy >= t.h) { memset(row, 0, out.w*sizeof(float)); continue; }
+                for (int i = 0; i < out.w && x + i < 0; i++) row[i] = 0;
+                for (int i = (t.w - x > 0) ? t.w - x : 0; i < out.w; i++) row[i] = 0;
+            }
+        }
+    }
+
+    int x0 = (x > 0) ? x : 0, y0 = (y > 0) ? y : 0;
+    int x1 = (x + out.w < t.w) ? x + out.w : t.w;
+    int y1 = (y + out.h < t.h) ? y + out.h : t.h;
+    if (x0 >= x1 || y0 >= y1) return;
+    for (int ty = y0 / t.tile; ty <= (y1 - 1) / t.tile; ty++)
+    {
+        for (int tx = x0 / t.tile; tx <= (x1 - 1) / t.tile; tx++)
+        {
+            image tile = acquire_tile(t, tx, ty);
+            int tx0 = tx*t.tile, ty0 = ty*t.tile;
+            int a = (x0 > tx0) ? x0 : tx0, b = (x1 < tx0 + tile.w) ? x1 : tx0 + tile.w;
+            int top = (y0 > ty0) ? y0 : ty0, bot = (y1 < ty0 + tile.h) ? y1 : ty0 + tile.h;
+            for (int c = 0; c < t.c; c++)
+            {
+                for (int sy = top; sy < bot; sy++)
+                {
+                    float *tp = image_row(tile, sy - ty0, c) + (a - tx0);
+                    float *op = image_row(out, sy - y, c) + (a - x);
+                    if (write) memcpy(tp, op, (b - a)*sizeof(float));
+                    else memcpy(op, tp, (b - a)*sizeof(float));
+                }
+            }
+            release_tile(t, tx, ty);
+        }
+    }
+}
+
+void read_tiled_region(tiled_image t, int x, int y, image out)
+{
+    tiled_region(t, x, y, out, 0);
+}
+
+void write_tiled_region(tiled_image t, int x, int y, image in)
+{
+    tiled_region(t, x, y, in, 1);
+}
+
+tiled_image tile_image(image im, int tile, int max_resident)
+{
+    tiled_image t = make_tiled_image(im.w, im.h, im.c, tile, max_resident);
+    for (int ty = 0; ty < t.tiles_y; ty++)
+    {
+        for (int tx = 0; tx < t.tiles_x; tx++)
+        {
+            image dst = acquire_tile(t, tx, ty);
+            copy_image_into(view_image(im, tx*tile, ty*tile, dst.w, dst.h), dst);
+            release_tile(t, tx, ty);
+        }
+    }
+    return t;
+}
+
+image untile_image(tiled_image t)
+{
+    image im = make_image_uninit(t.w, t.h, t.c);
+    read_tiled_region(t, 0, 0, im);
+    return im;
+}
+
+// Each output tile convolves its source window plus a halo of the filter
+// size. The halo is zero outside the image like get_pixel's padding, so
+// the result matches convolve_image.
+void convolve_tiled(tiled_image im, image filter, int preserve, tiled_image out)
+{
+    assert(im.cache != out.cache);
+    assert(out.w == im.w && out.h == im.h && out.c == (preserve ? im.c : 1));
+    int hx = filter.w / 2, hy = filter.h / 2;
+    // Sized by the output tiles, which are what the loop walks
+    int sw = out.tile + filter.w - 1, sh = out.tile + filter.h - 1;
+    image src = make_image_uninit(sw, sh, im.c);
+    image dst = make_image_uninit(sw, sh, out.c);
+    for (int ty = 0; ty < out.tiles_y; ty++)
+    {
+        for (int tx = 0; tx < out.tiles_x; tx++)
+        {
+            image tile = acquire_tile(out, tx, ty);
+            image s = view_image(src, 0, 0, tile.w + filter.w - 1, tile.h + filter.h - 1);
+            image d = view_image(dst, 0, 0, s.w, s.h);
+            read_tiled_region(im, tx*out.tile - hx, ty*out.tile - hy, s);
+            convolve_image_into(s, filter, preserve, d);
+            copy_image_into(view_image(d, hx, hy, tile.w, tile.h), tile);
+            release_tile(out, tx, ty);
+        }
+    }
+    free_image(src);
+    free_image(dst);
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// The distinct source positions taps [k0, k1) of one plan axis read, in
+// order, and each tap's index into them. Taps with weight 0 point at 0 and
+// read nothing; they map to the first position.
+static int gather_taps(const int *idx, const float *wt, int k0, int k1, int *pos, int *map)
+{
+    int n = 0;
+    for (int k = k0; k < k1; k++) if (wt[k] != 0) pos[n++] = idx[k];
+    qsort(pos, n, sizeof(int), compare_ints);
+    int m = 0;
+    for (int i = 0; i < n; i++) if (m == 0 || pos[m-1] != pos[i]) pos[m++] = pos[i];
+    if (m == 0) pos[m++] = 0;
+    for (int k = k0; k < k1; k++)
+    {
+        int lo = 0, hi = m - 1;
+        while (wt[k] != 0 && lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (pos[mid] < idx[k]) lo = mid + 1;
+            else hi = mid;
+        }
+        map[k - k0] = (wt[k] != 0) ? lo : 0;
+    }
+    return m;
+}
+
+// Same taps as resize_with_plan. Each output tile gathers only the source
+// rows and columns its taps read, at most two per output pixel, straight
+// from the source tiles, so scratch memory depends on the tile size and
+// not on the scale. The horizontal and vertical passes then run in the
+// same order so the result matches nn_resize / bilinear_resize.
+void resize_tiled(tiled_image im, tiled_image out, int method)
+{
+    assert(im.cache != out.cache && out.c == im.c);
+    resize_plan p = make_resize_plan(im.w, im.h, out.w, out.h, method);
+    int n = 2*out.tile;
+    int *cx = calloc(n, sizeof(int)), *ry = calloc(n, sizeof(int));
+    int *xmap = calloc(n, sizeof(int)), *ymap = calloc(n, sizeof(int));
+    image gathered = make_image_uninit(n, n, im.c);
+    for (int ty = 0; ty < out.tiles_y; ty++)
+    {
+        for (int tx = 0; tx < out.tiles_x; tx++)
+        {
+            image tile = acquire_tile(out, tx, ty);
+            int ox = tx*out.tile, oy = ty*out.tile;
+            int nx = gather_taps(p.xi, p.xw, 2*ox, 2*(ox + tile.w), cx, xmap);
+            int ny = gather_taps(p.yi, p.yw, 2*oy, 2*(oy + tile.h), ry, ymap);
+            image g = view_image(gathered, 0, 0, nx, ny);
+
+            // Positions are sorted, so each source tile is acquired once
+            for (int a = 0, a1; a < ny; a = a1)
+            {
+                int sty = ry[a] / im.tile;
+                for (a1 = a; a1 < ny && ry[a1] / im.tile == sty; a1++);
+                for (int b = 0, b1; b < nx; b = b1)
+                {
+                    int stx = cx[b] / im.tile;
+                    for (b1 = b; b1 < nx && cx[b1] / im.tile == stx; b1++);
+                    image st = acquire_tile(im, stx, sty);
+                    for (int c = 0; c < im.c; c++)
+                    {
+                        for (int r = a; r < a1; r++)
+                        {
+                            const float *s = image_row(st, ry[r] - sty*im.tile, c) - stx*im.tile;
+                            float *d = image_row(g, r, c);
+                            for (int q = b; q < b1; q++) d[q] = s[cx[q]];
+                        }
+                    }
+                    release_tile(im, stx, sty);
+                }
+            }
+
+            for (int c = 0; c < im.c; c++)
+            {
+                for (int j = 0; j < tile.h; j++)
+                {
+                    int jj = 2*(oy + j);
+                    const float *s1 = image_row(g, ymap[2*j], c), *s2 = image_row(g, ymap[2*j+1], c);
+                    float *row = image_row(tile, j, c);
+                    for (int i = 0; i < tile.w; i++)
+                    {
+                        int ii = 2*(ox + i);
+                        int a = xmap[2*i], b = xmap[2*i+1];
+                        float h1 = p.xw[ii]*s1[a] + p.xw[ii+1]*s1[b];
+                        float h2 = p.xw[ii]*s2[a] + p.xw[ii+1]*s2[b];
+                        row[i] = p.yw[jj]*h1 + p.yw[jj+1]*h2;
+                    }
+                }
+            }
+            release_tile(out, tx, ty);
+        }
+    }
+    free_image(gathered);
+    free(cx);
+    free(ry);
+    free(xmap);
+    free(ymap);
+    free_resize_plan(p);
+}
@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+#include "image.h"
+
+// Output is produced in square tiles so a large rotation walks the source
+// along a short diagonal per tile instead of across the whole image.
+#define WARP_TILE 32
+// Bilinear sampling range widening, in source pixels
+#define WARP_SLACK 1e-3
+
+int invert_affine(const float m[6], float inv[6])
+{
+    double det = (double)m[0]*m[4] - (double)m[1]*m[3];
+    if (det == 0) return 0;
+    inv[0] =  m[4] / det;
+    inv[1] = -m[1] / det;
+    inv[3] = -m[3] / det;
+    inv[4] =  m[0] / det;
+    inv[2] = -(inv[0]*m[2] + inv[1]*m[5]);
+    inv[5] = -(inv[3]*m[2] + inv[4]*m[5]);
+    return 1;
+}
+
+void make_rotation_affine(float m[6], float theta, float cx, float cy)
+{
+    float c = cosf(theta);
+    float s = sinf(theta);
+    m[0] = c; m[1] = -s; m[2] = cx - c*cx + s*cy;
+    m[3] = s; m[4] =  c; m[5] = cy - s*cx - c*cy;
+}
+
+void make_shear_affine(float m[6], float kx, float ky)
+{
+    m[0] = 1;  m[1] = kx; m[2] = 0;
+    m[3] = ky; m[4] = 1;  m[5] = 0;
+}
+
+// Narrows [*x0, *x1) to the x where a + b*x lies in [lo, hi]
+static void clip_span(double a, double b, double lo, double hi, int *x0, int *x1)
+{
+    if (b == 0)
+    {
+        if (a < lo || a > hi) *x1 = *x0;
+        return;
+    }
+    double t0 = (lo - a) / b;
+    double t1 = (hi - a) / b;
+    if (t0 > t1) { double t = t0; t0 = t1; t1 = t; }
+    // A tiny b (float cos(pi/2) is about -4e-8) puts the bounds far out of
+    // int range, so clamp them to the span before converting
+    t0 = fmax(t0, *x0);
+    t1 = fmin(t1, *x1);
+    int s = (int)ceil(t0);
+    int e = (int)floor(t1) + 1;
+    if (s > *x0) *x0 = s;
+    if (e < *x1) *x1 = e;
+    if (*x1 < *x0) *x1 = *x0;
+}
+
+// Same as nn_interpolate / bilinear_interpolate for in-bounds coordinates,
+// without get_pixel's per tap bounds checks. The coordinate is clamped so
+// float drift at the ends of a span can never read outside the plane.
+static inline float sample_nn(const float *plane, size_t stride, int w, int h, float x, float y)
+{
+    int xi = (int)(x + .5f);
+    int yi = (int)(y + .5f);
+    xi = xi < 0 ? 0 : (xi >= w ? w - 1 : xi);
+    yi = yi < 0 ? 0 : (yi >= h ? h - 1 : yi);
+    return plane[yi*stride + xi];
+}
+
+static inline float sample_bilinear(const float *plane, size_t stride, int w, int h, float x, float y)
+{
+    x = x < 0 ? 0 : (x > w - 1 ? w - 1 : x);
+    y = y < 0 ? 0 : (y > h - 1 ? h - 1 : y);
+    int x1 = (int)x;
+    int y1 = (int)y;
+    int x2 = x1 + (x1 < w - 1);
+    int y2 = y1 + (y1 < h - 1);
+    float dx = x - x1;
+    float dy = y - y1;
+    float q11 = plane[y1*stride + x1];
+    float q21 = plane[y1*stride + x2];
+    float q12 = plane[y2*stride + x1];
+    float q22 = plane[y2*stride + x2];
+    return ((1 - dx) * (1 - dy) * q11) + (dx * (1 - dy) * q21) + ((1 - dx) * dy * q12) + (dx * dy * q22);
+}
+
+image warp_affine(image im, const float m[6], int w, int h, int method, float fill)
+{
+    assert(im.layout == LAYOUT_CHW && im.type == IMAGE_F32);
+    image out = make_image(w, h, im.c);
+    float inv[6];
+    if (!invert_affine(m, inv))
+    {
+        for (int c = 0; c < im.c; c++)
+        {
+            for (int y = 0; y < h; y++)
+            {
+                float *row = image_row(out, y, c);
+                for (int x = 0; x < w; x++) row[x] = fill;
+            }
+        }
+        return out;
+    }
+
+    // Source coordinates that can be sampled without touching padding,
+    // with some slack for the rounding in float matrices. The samplers
+    // clamp, so the slack never reads outside the plane.
+    double lo = (method == RESIZE_NN) ? -.5 : -WARP_SLACK;
+    double hi_x = (method == RESIZE_NN) ? im.w - .5 : im.w - 1 + WARP_SLACK;
+    double hi_y = (method == RESIZE_NN) ? im.h - .5 : im.h - 1 + WARP_SLACK;
+
+    for (int ty = 0; ty < h; ty += WARP_TILE)
+    {
+        for (int tx = 0; tx < w; tx += WARP_TILE)
+        {
+            int ty1 = (ty + WARP_TILE < h) ? ty + WARP_TILE : h;
+            int tx1 = (tx + WARP_TILE < w) ? tx + WARP_TILE : w;
+            for (int y = ty; y < ty1; y++)
+            {
+                // Source position of (0, y); x then advances by one column
+                double ax = (double)inv[1]*y + inv[2];
+                double ay = (double)inv[4]*y + inv[5];
+                int x0 = tx, x1 = tx1;
+                clip_span(ax, inv[0], lo, hi_x, &x0, &x1);
+                clip_span(ay, inv[3], lo, hi_y, &x0, &x1);
+
+                for (int c = 0; c < im.c; c++)
+                {
+                    const float *plane = image_row(im, 0, c);
+                    float *row = image_row(out, y, c);
+                    for (int x = tx; x < x0; x++) row[x] = fill;
+                    for (int x = x1; x < tx1; x++) row[x] = fill;
+
+                    float sx = ax + (double)inv[0]*x0;
+                    float sy = ay + (double)inv[3]*x0;
+                    float dsx = inv[0], dsy = inv[3];
+                    if (method == RESIZE_NN)
+                    {
+                        for (int x = x0; x < x1; x++, sx += dsx, sy += dsy)
+                        {
+                            row[x] = sample_nn(plane, im.stride, im.w, im.h, sx, sy);
+                        }
+                    }
+                    else
+                    {
+                        for (int x = x0; x < x1; x++, sx += dsx, sy += dsy)
+                        {
+                            row[x] = sample_bilinear(plane, im.stride, im.w, im.h, sx, sy);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return out;
+}
+
+image rotate_image(image im, float theta, int method)
+{
+    float m[6];
+    make_rotation_affine(m, theta, (im.w - 1) / 2.f, (im.h - 1) / 2.f);
+    return warp_affine(im, m, im.w, im.h, method, 0);
+}
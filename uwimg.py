@@ -14,12 +14,25 @@ class IMAGE(Structure):
     _fields_ = [("w", c_int),
                 ("h", c_int),
                 ("c", c_int),
-                ("data", POINTER(c_float))]
+                ("data", POINTER(c_float)),
+                ("step", c_int),
+                ("stride", c_size_t),
+                ("plane", c_size_t),
+                ("layout", c_int),
+                ("type", c_int),
+                ("mem", c_void_p)]
     def __add__(self, other):
         return add_image(self, other)
     def __sub__(self, other):
         return sub_image(self, other)
 
+class HISTOGRAM(Structure):
+    _fields_ = [("bins", c_int),
+                ("c", c_int),
+                ("lo", c_float),
+                ("hi", c_float),
+                ("counts", POINTER(c_uint64))]
+
 add_image = lib.add_image
 add_image.argtypes = [IMAGE, IMAGE]
 add_image.restype = IMAGE
@@ -71,6 +84,30 @@ shift_image = lib.shift_image
 shift_image.argtypes = [IMAGE, c_int, c_float]
 shift_image.restype = None
 
+scale_image = lib.scale_image
+scale_image.argtypes = [IMAGE, c_int, c_float]
+scale_image.restype = None
+
+set_linear_light = lib.set_linear_light
+set_linear_light.argtypes = [c_int]
+set_linear_light.restype = None
+
+make_histogram = lib.make_histogram
+make_histogram.argtypes = [IMAGE, c_int, c_float, c_float]
+make_histogram.restype = HISTOGRAM
+
+free_histogram = lib.free_histogram
+free_histogram.argtypes = [HISTOGRAM]
+free_histogram.restype = None
+
+equalize_histogram = lib.equalize_histogram
+equalize_histogram.argtypes = [IMAGE, c_int]
+equalize_histogram.restype = None
+
+clahe_image = lib.clahe_image
+clahe_image.argtypes = [IMAGE, c_int, c_int, c_float]
+clahe_image.restype = None
+
 load_image_lib = lib.load_image
 load_image_lib.argtypes = [c_char_p]
 load_image_lib.restype = IMAGE
@@ -78,6 +115,20 @@ load_image_lib.restype = IMAGE
 def load_image(f):
     return load_image_lib(f.encode('ascii'))
 
+load_image_rgba_lib = lib.load_image_rgba
+load_image_rgba_lib.argtypes = [c_char_p]
+load_image_rgba_lib.restype = IMAGE
+
+def load_image_rgba(f):
+    return load_image_rgba_lib(f.encode('ascii'))
+
+load_image_resized_lib = lib.load_image_resized
+load_image_resized_lib.argtypes = [c_char_p, c_int, c_int]
+load_image_resized_lib.restype = IMAGE
+
+def load_image_resized(f, w, h):
+    return load_image_resized_lib(f.encode('ascii'), w, h)
+
 save_png_lib = lib.save_png
 save_png_lib.argtypes = [IMAGE, c_char_p]
 save_png_lib.restype = None